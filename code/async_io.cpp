@@ -0,0 +1,664 @@
+#include "async_io.h"
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavformat/version.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+}
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+// The io_uring engine needs -luring at link time, so it is opt-in:
+// define VIDEO_CONVERTER_HAVE_LIBURING when building against liburing
+#if defined(__linux__) && defined(VIDEO_CONVERTER_HAVE_LIBURING)
+#include <liburing.h>
+#define ASYNC_IO_HAVE_IO_URING 1
+#endif
+
+// libavformat 61 made the write callback's buffer const
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+typedef const uint8_t* avio_write_buffer;
+#else
+typedef uint8_t* avio_write_buffer;
+#endif
+
+// Number of chunk-sized reads kept in flight ahead of the demuxer
+static const int kInputQueueDepth = 8;
+// Size of each read-ahead / write-behind request
+static const size_t kChunkSize = 2 * 1024 * 1024;
+// Write-behind ring used when the caller does not pick a size
+static const int64_t kDefaultOutputBufferSize = 64 * 1024 * 1024;
+// Buffer the AVIOContext itself copies through
+static const int kAvioBufferSize = 64 * 1024;
+// Worker threads used by the fallback engine. Output gets a single dedicated
+// writer so chunks reach the disk in order.
+static const int kInputFallbackThreads = 4;
+static const int kOutputFallbackThreads = 1;
+// Buffer, offset and length alignment required for O_DIRECT transfers
+static const size_t kDirectAlignment = 4096;
+
+struct IoRequest {
+    int fd;
+    bool write;
+    uint8_t* buf;
+    size_t len;      // Bytes requested (or, for a write being filled, buffered so far)
+    int64_t offset;  // File offset of buf[0]
+    size_t done;     // Bytes transferred so far
+    size_t prefix;   // Bytes at the front of a write read back from the file to align it
+    int64_t result;  // Outcome of the last submission: byte count or AVERROR
+    bool in_flight;
+};
+
+static int64_t positional_io(int fd, bool write, uint8_t* buf, size_t len, int64_t offset) {
+#if defined(_WIN32)
+    HANDLE h = (HANDLE)_get_osfhandle(fd);
+    OVERLAPPED ov = {};
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD n = 0;
+    BOOL ok = write ? WriteFile(h, buf, (DWORD)len, &n, &ov)
+                    : ReadFile(h, buf, (DWORD)len, &n, &ov);
+    if (!ok)
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : AVERROR(EIO);
+    return n;
+#else
+    ssize_t n;
+    do {
+        n = write ? pwrite(fd, buf, len, offset) : pread(fd, buf, len, offset);
+    } while (n < 0 && errno == EINTR);
+    return n < 0 ? AVERROR(errno) : n;
+#endif
+}
+
+// Executes positional reads and writes on behalf of an AsyncFile. Requests may
+// complete in any order.
+class IoEngine {
+public:
+    virtual ~IoEngine() {}
+    // Queues the untransferred remainder of `req`. Returns 0 or a negative AVERROR code.
+    virtual int submit(IoRequest* req) = 0;
+    // Blocks until a submitted request finishes, stores its outcome in
+    // req->result and returns it. Returns nullptr if the engine has failed.
+    virtual IoRequest* wait() = 0;
+};
+
+#ifdef ASYNC_IO_HAVE_IO_URING
+class IoUringEngine : public IoEngine {
+public:
+    // Returns nullptr when io_uring is unavailable (old kernel, seccomp, RLIMIT_MEMLOCK)
+    static IoUringEngine* create(unsigned entries) {
+        IoUringEngine* engine = new IoUringEngine();
+        if (io_uring_queue_init(entries, &engine->ring_, 0) < 0) {
+            engine->initialized_ = false;
+            delete engine;
+            return nullptr;
+        }
+        return engine;
+    }
+
+    ~IoUringEngine() override {
+        if (initialized_)
+            io_uring_queue_exit(&ring_);
+    }
+
+    int submit(IoRequest* req) override {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        if (!sqe)
+            return AVERROR(EBUSY);
+        if (req->write)
+            io_uring_prep_write(sqe, req->fd, req->buf + req->done, (unsigned)(req->len - req->done),
+                                req->offset + req->done);
+        else
+            io_uring_prep_read(sqe, req->fd, req->buf + req->done, (unsigned)(req->len - req->done),
+                               req->offset + req->done);
+        io_uring_sqe_set_data(sqe, req);
+        int ret = io_uring_submit(&ring_);
+        return ret < 0 ? AVERROR(-ret) : 0;
+    }
+
+    IoRequest* wait() override {
+        struct io_uring_cqe* cqe = nullptr;
+        int ret;
+        do {
+            ret = io_uring_wait_cqe(&ring_, &cqe);
+        } while (ret == -EINTR);
+        if (ret < 0)
+            return nullptr;
+        IoRequest* req = (IoRequest*)io_uring_cqe_get_data(cqe);
+        req->result = cqe->res < 0 ? AVERROR(-cqe->res) : cqe->res;
+        io_uring_cqe_seen(&ring_, cqe);
+        return req;
+    }
+
+private:
+    IoUringEngine() : initialized_(true) {}
+
+    bool initialized_;
+    struct io_uring ring_;
+};
+#endif
+
+class ThreadEngine : public IoEngine {
+public:
+    explicit ThreadEngine(int threads) : stopping_(false) {
+        for (int i = 0; i < threads; i++)
+            workers_.emplace_back(&ThreadEngine::run, this);
+    }
+
+    ~ThreadEngine() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        submitted_.notify_all();
+        for (std::thread& worker : workers_)
+            worker.join();
+    }
+
+    int submit(IoRequest* req) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(req);
+        }
+        submitted_.notify_one();
+        return 0;
+    }
+
+    IoRequest* wait() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        completed_cv_.wait(lock, [this] { return !completed_.empty(); });
+        IoRequest* req = completed_.front();
+        completed_.pop_front();
+        return req;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            submitted_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (pending_.empty())
+                return;
+            IoRequest* req = pending_.front();
+            pending_.pop_front();
+            lock.unlock();
+            int64_t result = positional_io(req->fd, req->write, req->buf + req->done,
+                                           req->len - req->done, req->offset + req->done);
+            lock.lock();
+            req->result = result;
+            completed_.push_back(req);
+            completed_cv_.notify_one();
+        }
+    }
+
+    bool stopping_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable submitted_;
+    std::condition_variable completed_cv_;
+    std::deque<IoRequest*> pending_;
+    std::deque<IoRequest*> completed_;
+};
+
+static IoEngine* create_engine(int depth, int fallback_threads) {
+#ifdef ASYNC_IO_HAVE_IO_URING
+    if (IoEngine* engine = IoUringEngine::create((unsigned)depth))
+        return engine;
+#else
+    (void)depth;
+#endif
+    return new ThreadEngine(fallback_threads);
+}
+
+static uint8_t* alloc_aligned(size_t size) {
+#if defined(_WIN32)
+    return (uint8_t*)_aligned_malloc(size, kDirectAlignment);
+#else
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, kDirectAlignment, size) == 0 ? (uint8_t*)ptr : nullptr;
+#endif
+}
+
+static void free_aligned(uint8_t* ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+static void close_fd(int fd) {
+#if defined(_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+struct AsyncFile {
+    int fd;
+    int direct_fd;       // Output: O_DIRECT descriptor for aligned chunks, or -1
+    IoEngine* engine;
+    std::vector<IoRequest> slots;
+    int head;            // Input: slot holding pos. Output: slot being filled.
+    int64_t pos;         // Logical position of the AVIOContext
+    int64_t size;        // Input: file size. Output: furthest byte written.
+    int64_t next_offset; // Input: offset the next recycled slot will read from
+    int error;           // First I/O error seen, reported on the next callback
+    AsyncOutputStats stats;
+};
+
+static void mark_failed(AsyncFile* f, int err) {
+    if (!f->error)
+        f->error = err;
+}
+
+static void submit_request(AsyncFile* f, IoRequest* req) {
+    req->in_flight = true;
+    int ret = f->engine->submit(req);
+    if (ret < 0) {
+        req->in_flight = false;
+        mark_failed(f, ret);
+    }
+}
+
+// Retires one completion, resubmitting the remainder of short transfers
+static void reap_one(AsyncFile* f) {
+    IoRequest* req = f->engine->wait();
+    if (!req) {
+        // The engine itself is broken; nothing further will complete
+        for (IoRequest& slot : f->slots)
+            slot.in_flight = false;
+        mark_failed(f, AVERROR(EIO));
+        return;
+    }
+    if (req->result < 0) {
+        req->in_flight = false;
+        mark_failed(f, (int)req->result);
+        return;
+    }
+    req->done += (size_t)req->result;
+    bool more = req->done < req->len && (req->write || req->offset + (int64_t)req->done < f->size);
+    if (req->result > 0 && more) {
+        submit_request(f, req);
+        return;
+    }
+    req->in_flight = false;
+    if (req->write) {
+        if (req->done < req->len)
+            mark_failed(f, AVERROR(EIO));
+        if (req->offset + (int64_t)req->done > f->size)
+            f->size = req->offset + req->done;
+    }
+}
+
+static void wait_for(AsyncFile* f, IoRequest* req) {
+    while (req->in_flight)
+        reap_one(f);
+}
+
+static void drain(AsyncFile* f) {
+    for (IoRequest& slot : f->slots)
+        wait_for(f, &slot);
+}
+
+// Output variants of wait_for/drain that charge the wait to the muxer
+static void wait_for_output(AsyncFile* f, IoRequest* req) {
+    if (!req->in_flight)
+        return;
+    int64_t start = av_gettime_relative();
+    wait_for(f, req);
+    f->stats.blocked_us += av_gettime_relative() - start;
+    f->stats.blocked_waits++;
+}
+
+static void drain_output(AsyncFile* f) {
+    for (IoRequest& slot : f->slots)
+        wait_for_output(f, &slot);
+}
+
+// Takes ownership of `fd` even on failure
+static AsyncFile* create_async_file(int fd, bool write, int depth, int fallback_threads) {
+    AsyncFile* f = new AsyncFile();
+    f->fd = fd;
+    f->direct_fd = -1;
+    f->slots.resize(depth);
+    for (IoRequest& slot : f->slots) {
+        slot.fd = fd;
+        slot.write = write;
+        slot.buf = alloc_aligned(kChunkSize);
+        if (!slot.buf) {
+            for (IoRequest& allocated : f->slots)
+                free_aligned(allocated.buf);
+            close_fd(fd);
+            delete f;
+            return nullptr;
+        }
+    }
+    f->engine = create_engine(depth, fallback_threads);
+    return f;
+}
+
+static void destroy_async_file(AsyncFile* f) {
+    drain(f);
+    delete f->engine;
+    for (IoRequest& slot : f->slots)
+        free_aligned(slot.buf);
+    close_fd(f->fd);
+    if (f->direct_fd >= 0)
+        close_fd(f->direct_fd);
+    delete f;
+}
+
+// ---------------------------------------------------------------------------
+// Input: a window of kInputQueueDepth consecutive chunks starting at the chunk
+// holding pos, each slot refilled with the next chunk as soon as it is consumed.
+
+static void schedule_read(AsyncFile* f, IoRequest* slot, int64_t offset) {
+    slot->offset = offset;
+    slot->done = 0;
+    slot->len = offset < f->size ? (size_t)FFMIN((int64_t)kChunkSize, f->size - offset) : 0;
+    if (slot->len > 0)
+        submit_request(f, slot);
+}
+
+static void restart_prefetch(AsyncFile* f, int64_t pos) {
+    drain(f);
+    int64_t offset = pos - pos % (int64_t)kChunkSize;
+    for (IoRequest& slot : f->slots) {
+        schedule_read(f, &slot, offset);
+        offset += kChunkSize;
+    }
+    f->head = 0;
+    f->next_offset = offset;
+}
+
+// Hands the head slot its next chunk and moves on to the following slot
+static void recycle_head(AsyncFile* f) {
+    schedule_read(f, &f->slots[f->head], f->next_offset);
+    f->next_offset += kChunkSize;
+    f->head = (f->head + 1) % (int)f->slots.size();
+}
+
+static int async_read(void* opaque, uint8_t* buf, int buf_size) {
+    AsyncFile* f = (AsyncFile*)opaque;
+    if (f->error)
+        return f->error;
+    if (f->pos >= f->size)
+        return AVERROR_EOF;
+
+    IoRequest* slot = &f->slots[f->head];
+    wait_for(f, slot);
+    if (f->error)
+        return f->error;
+    int64_t in_slot = f->pos - slot->offset;
+    // The file shrank underneath us
+    if (in_slot >= (int64_t)slot->done)
+        return AVERROR_EOF;
+    int n = (int)FFMIN((int64_t)buf_size, (int64_t)slot->done - in_slot);
+    memcpy(buf, slot->buf + in_slot, n);
+    f->pos += n;
+    if (f->pos >= slot->offset + (int64_t)slot->len)
+        recycle_head(f);
+    return n;
+}
+
+static int64_t async_input_seek(void* opaque, int64_t offset, int whence) {
+    AsyncFile* f = (AsyncFile*)opaque;
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return f->size;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = f->pos + offset;
+        break;
+    case SEEK_END:
+        pos = f->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    int64_t window_start = f->slots[f->head].offset;
+    if (pos >= window_start && pos < f->next_offset) {
+        // Short forward skip: retire the chunks we jump over but keep the rest in flight
+        while (pos >= f->slots[f->head].offset + (int64_t)kChunkSize) {
+            wait_for(f, &f->slots[f->head]);
+            recycle_head(f);
+        }
+    } else {
+        restart_prefetch(f, pos);
+    }
+    f->pos = pos;
+    return pos;
+}
+
+AVIOContext* async_input_open(const char* path) {
+#if defined(_WIN32)
+    int fd = _open(path, _O_RDONLY | _O_BINARY);
+    struct _stat64 st;
+    if (fd < 0 || _fstat64(fd, &st) < 0 || (st.st_mode & _S_IFMT) != _S_IFREG) {
+        if (fd >= 0)
+            close_fd(fd);
+        return nullptr;
+    }
+#else
+    // Only regular files, checked before opening: opening a FIFO blocks until
+    // a writer connects, and the writer would then see this reader go away
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+        return nullptr;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0)
+            close_fd(fd);
+        return nullptr;
+    }
+#endif
+
+    AsyncFile* f = create_async_file(fd, false, kInputQueueDepth, kInputFallbackThreads);
+    if (!f)
+        return nullptr;
+    f->size = st.st_size;
+    restart_prefetch(f, 0);
+
+    unsigned char* buffer = (unsigned char*)av_malloc(kAvioBufferSize);
+    AVIOContext* pb = buffer ? avio_alloc_context(buffer, kAvioBufferSize, 0, f,
+                                                  async_read, nullptr, async_input_seek)
+                             : nullptr;
+    if (!pb) {
+        av_free(buffer);
+        destroy_async_file(f);
+        return nullptr;
+    }
+    return pb;
+}
+
+void async_input_close(AVIOContext** pb) {
+    if (!pb || !*pb)
+        return;
+    AsyncFile* f = (AsyncFile*)(*pb)->opaque;
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+    destroy_async_file(f);
+}
+
+// ---------------------------------------------------------------------------
+// Output: muxer writes are gathered into the head slot, which is submitted once
+// full. Seeks (the MP4 muxer patches sizes and appends moov at the end) flush
+// and drain first so overlapping writes can never be reordered.
+
+static void submit_head_write(AsyncFile* f) {
+    IoRequest* slot = &f->slots[f->head];
+    if (slot->len == 0 || slot->done == slot->len)
+        return;
+    // O_DIRECT only takes aligned transfers; the tail chunk and the muxer's
+    // back-patches go through the page cache instead
+    bool aligned = slot->offset % kDirectAlignment == 0 && slot->len % kDirectAlignment == 0;
+    slot->fd = f->direct_fd >= 0 && aligned ? f->direct_fd : f->fd;
+    slot->done = 0;
+    submit_request(f, slot);
+    f->stats.bytes_written += slot->len - slot->prefix;
+    f->head = (f->head + 1) % (int)f->slots.size();
+}
+
+// After a seek the next chunk would start mid-block, and so would every chunk
+// after it, keeping the rest of the file off the O_DIRECT path. Starting the
+// chunk at the block boundary instead, with the bytes the file already holds
+// in front of the position read back into it, realigns the stream.
+static void align_new_chunk(AsyncFile* f, IoRequest* slot) {
+    size_t prefix = (size_t)(f->pos % (int64_t)kDirectAlignment);
+    if (f->direct_fd < 0 || prefix == 0)
+        return;
+    int64_t start = f->pos - (int64_t)prefix;
+    int64_t n = start < f->size ? positional_io(f->fd, false, slot->buf, prefix, start) : 0;
+    if (n < 0)
+        return; // Left unaligned: written through the page cache
+    // Past the end of the file is a hole, which reads back as zeros
+    memset(slot->buf + n, 0, prefix - (size_t)n);
+    slot->offset = start;
+    slot->len = prefix;
+    slot->prefix = prefix;
+}
+
+static int async_write(void* opaque, avio_write_buffer buf, int buf_size) {
+    AsyncFile* f = (AsyncFile*)opaque;
+    int remaining = buf_size;
+    while (remaining > 0) {
+        IoRequest* slot = &f->slots[f->head];
+        // Only blocks when the whole ring is waiting on storage
+        wait_for_output(f, slot);
+        if (f->error)
+            return f->error;
+        if (slot->len == 0 || slot->done == slot->len) {
+            // Slot is free: start a new chunk at the current position
+            slot->offset = f->pos;
+            slot->len = 0;
+            slot->done = 0;
+            slot->prefix = 0;
+            align_new_chunk(f, slot);
+        }
+        size_t n = FFMIN(kChunkSize - slot->len, (size_t)remaining);
+        memcpy(slot->buf + slot->len, buf, n);
+        slot->len += n;
+        buf += n;
+        remaining -= (int)n;
+        f->pos += n;
+        if (slot->len == kChunkSize)
+            submit_head_write(f);
+    }
+    return buf_size;
+}
+
+static int64_t async_output_seek(void* opaque, int64_t offset, int whence) {
+    AsyncFile* f = (AsyncFile*)opaque;
+    if ((whence & ~AVSEEK_FORCE) == AVSEEK_SIZE)
+        return FFMAX(f->size, f->pos);
+
+    submit_head_write(f);
+    drain_output(f);
+    if (f->error)
+        return f->error;
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = f->pos + offset;
+        break;
+    case SEEK_END:
+        pos = f->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+    f->pos = pos;
+    // Every slot is idle now; make the next write start a fresh chunk
+    for (IoRequest& slot : f->slots)
+        slot.len = 0;
+    return pos;
+}
+
+AVIOContext* async_output_open(const char* path, int64_t buffer_size, int direct_io) {
+    // Positional writes need a regular file; FIFOs and devices are left to avio_open
+    struct stat st;
+    if (stat(path, &st) == 0 && (st.st_mode & S_IFMT) != S_IFREG)
+        return nullptr;
+#if defined(_WIN32)
+    int fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    // Realigning O_DIRECT writes after a seek reads back the partial block
+    int fd = open(path, (direct_io ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0)
+        return nullptr;
+
+    if (buffer_size <= 0)
+        buffer_size = kDefaultOutputBufferSize;
+    int depth = (int)FFMAX(buffer_size / (int64_t)kChunkSize, (int64_t)2);
+    AsyncFile* f = create_async_file(fd, true, depth, kOutputFallbackThreads);
+    if (!f)
+        return nullptr;
+#ifdef O_DIRECT
+    // Filesystems without O_DIRECT support (tmpfs, some FUSE mounts) refuse the
+    // open; everything then simply goes through the page cache
+    if (direct_io)
+        f->direct_fd = open(path, O_WRONLY | O_DIRECT);
+#else
+    (void)direct_io;
+#endif
+
+    unsigned char* buffer = (unsigned char*)av_malloc(kAvioBufferSize);
+    AVIOContext* pb = buffer ? avio_alloc_context(buffer, kAvioBufferSize, 1, f,
+                                                  nullptr, async_write, async_output_seek)
+                             : nullptr;
+    if (!pb) {
+        av_free(buffer);
+        destroy_async_file(f);
+        return nullptr;
+    }
+    return pb;
+}
+
+int async_output_close(AVIOContext** pb, AsyncOutputStats* stats) {
+    if (!pb || !*pb)
+        return 0;
+    avio_flush(*pb);
+    AsyncFile* f = (AsyncFile*)(*pb)->opaque;
+    submit_head_write(f);
+    drain_output(f);
+    int ret = f->error;
+    if (stats)
+        *stats = f->stats;
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+    destroy_async_file(f);
+    return ret;
+}
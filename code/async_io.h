@@ -0,0 +1,46 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <cstdint>
+
+struct AVIOContext;
+
+// Asynchronous file I/O for the demuxer and muxer.
+//
+// Reads are issued in large chunks that are kept in flight ahead of the
+// demuxer's position, and muxer writes are gathered into large chunks that are
+// written behind the encode loop. On Linux the requests go through io_uring
+// when the build defines VIDEO_CONVERTER_HAVE_LIBURING (and links -luring) and
+// the kernel allows it at run time; everywhere else a small pool of threads
+// issues positional reads and writes instead. Output uses a single dedicated
+// writer thread in that case.
+
+struct AsyncOutputStats {
+    int64_t bytes_written;
+    int64_t blocked_us;    // Time the muxer spent waiting for the writer
+    int64_t blocked_waits; // Number of times it had to wait
+};
+
+// Opens a regular file for prefetched reading. Returns nullptr when the path is
+// not a regular file or cannot be opened.
+AVIOContext* async_input_open(const char* path);
+
+// Waits for outstanding reads, then frees the context and closes the file.
+// Must be called after avformat_close_input, which leaves custom I/O alone.
+void async_input_close(AVIOContext** pb);
+
+// Creates (or truncates) `path` for write-behind output through a ring of
+// page-aligned chunks totalling `buffer_size` bytes (0 picks a default). The
+// muxer only blocks once the whole ring is queued on storage. With `direct_io`
+// set, full chunks are written with O_DIRECT where the platform and filesystem
+// support it; after a muxer seek the partial block in front of the new position
+// is read back so the chunks that follow stay aligned. Returns nullptr on
+// failure or when `path` exists and is not a regular file.
+AVIOContext* async_output_open(const char* path, int64_t buffer_size, int direct_io);
+
+// Flushes buffered data, waits for every outstanding write, then frees the
+// context and closes the file. Fills `stats` when non-null. Returns 0 on
+// success or a negative AVERROR code if any write failed.
+int async_output_close(AVIOContext** pb, AsyncOutputStats* stats);
+
+#endif // ASYNC_IO_H
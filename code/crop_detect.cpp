@@ -0,0 +1,151 @@
+#include "crop_detect.h"
+
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CROP_DETECT_SSE2 1
+#endif
+
+// Mean 8-bit luma up to which a row or column counts as black. Above limited
+// range black (16) to allow for noise and compression, like FFmpeg's
+// cropdetect default.
+static const int kBlackLimit = 24;
+
+struct CropDetector {
+    int width;
+    int height;
+    int bit_depth;
+    std::vector<uint32_t> column_sums;
+    // Bounds of the content seen so far, inclusive; min > max while none
+    int min_x;
+    int max_x;
+    int min_y;
+    int max_y;
+};
+
+// Sums one row into `column_sums` and returns its total
+static uint64_t add_row8(const uint8_t* row, int width, uint32_t* column_sums) {
+    uint64_t total = 0;
+    int x = 0;
+#if CROP_DETECT_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; x + 16 <= width; x += 16) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(row + x));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(px, zero));
+        __m128i lo = _mm_unpacklo_epi8(px, zero);
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        __m128i* sums = (__m128i*)(column_sums + x);
+        _mm_storeu_si128(sums, _mm_add_epi32(_mm_loadu_si128(sums), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(sums + 1, _mm_add_epi32(_mm_loadu_si128(sums + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(sums + 2, _mm_add_epi32(_mm_loadu_si128(sums + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(sums + 3, _mm_add_epi32(_mm_loadu_si128(sums + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+    total = (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (; x < width; x++) {
+        total += row[x];
+        column_sums[x] += row[x];
+    }
+    return total;
+}
+
+// add_row8 for 16-bit samples of at most 15 bits
+static uint64_t add_row16(const uint16_t* row, int width, uint32_t* column_sums) {
+    uint64_t total = 0;
+    int x = 0;
+#if CROP_DETECT_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i acc = zero;
+    for (; x + 8 <= width; x += 8) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(row + x));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(px, ones));
+        __m128i* sums = (__m128i*)(column_sums + x);
+        _mm_storeu_si128(sums, _mm_add_epi32(_mm_loadu_si128(sums), _mm_unpacklo_epi16(px, zero)));
+        _mm_storeu_si128(sums + 1, _mm_add_epi32(_mm_loadu_si128(sums + 1), _mm_unpackhi_epi16(px, zero)));
+    }
+    acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+    total = (uint32_t)_mm_cvtsi128_si32(acc);
+#endif
+    for (; x < width; x++) {
+        total += row[x];
+        column_sums[x] += row[x];
+    }
+    return total;
+}
+
+CropDetector* crop_detector_create(int width, int height, int bit_depth) {
+    if (width <= 0 || height <= 0)
+        return nullptr;
+    CropDetector* detector = new CropDetector();
+    detector->width = width;
+    detector->height = height;
+    detector->bit_depth = bit_depth > 8 ? bit_depth : 8;
+    detector->column_sums.assign(width, 0);
+    detector->min_x = width;
+    detector->max_x = -1;
+    detector->min_y = height;
+    detector->max_y = -1;
+    return detector;
+}
+
+void crop_detector_add(CropDetector* detector, const uint8_t* luma, int linesize) {
+    int width = detector->width;
+    int height = detector->height;
+    uint64_t limit = (uint64_t)kBlackLimit << (detector->bit_depth - 8);
+    detector->column_sums.assign(width, 0);
+    uint32_t* column_sums = detector->column_sums.data();
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = luma + (int64_t)y * linesize;
+        uint64_t total = detector->bit_depth > 8 ? add_row16((const uint16_t*)row, width, column_sums) :
+            add_row8(row, width, column_sums);
+        if (total > limit * width) {
+            if (y < detector->min_y)
+                detector->min_y = y;
+            if (y > detector->max_y)
+                detector->max_y = y;
+        }
+    }
+    for (int x = 0; x < width; x++) {
+        if (column_sums[x] > limit * height) {
+            if (x < detector->min_x)
+                detector->min_x = x;
+            if (x > detector->max_x)
+                detector->max_x = x;
+        }
+    }
+}
+
+bool crop_detector_get(const CropDetector* detector, int* x, int* y, int* width, int* height) {
+    if (detector->max_x < detector->min_x || detector->max_y < detector->min_y)
+        return false;
+    // Round outwards to even edges so no content row or column is lost
+    int left = detector->min_x & ~1;
+    int top = detector->min_y & ~1;
+    int right = (detector->max_x + 2) & ~1;
+    int bottom = (detector->max_y + 2) & ~1;
+    if (right > (detector->width & ~1))
+        right = detector->width & ~1;
+    if (bottom > (detector->height & ~1))
+        bottom = detector->height & ~1;
+    if (left == 0 && top == 0 && right == (detector->width & ~1) && bottom == (detector->height & ~1))
+        return false;
+    // Scope or widescreen bars never take half the frame; so much black means
+    // the samples were dark, not letterboxed
+    if ((right - left) * 2 < detector->width || (bottom - top) * 2 < detector->height)
+        return false;
+    *x = left;
+    *y = top;
+    *width = right - left;
+    *height = bottom - top;
+    return true;
+}
+
+void crop_detector_free(CropDetector** detector) {
+    delete *detector;
+    *detector = nullptr;
+}
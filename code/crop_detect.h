@@ -0,0 +1,27 @@
+#ifndef CROP_DETECT_H
+#define CROP_DETECT_H
+
+#include <cstdint>
+
+struct CropDetector;
+
+// Finds the black bars of letterboxed or pillarboxed video. Every frame added
+// contributes the rows and columns whose mean luma rises above black, and the
+// result is the rectangle holding all of them, so sampling several points of
+// a film keeps dark scenes from cropping into the picture.
+
+// `bit_depth` above 8 means 16-bit little-endian luma samples of that depth
+// (up to 15 bits). Returns nullptr for an empty frame size.
+CropDetector* crop_detector_create(int width, int height, int bit_depth);
+
+// Adds a frame's luma plane, of the size given at creation
+void crop_detector_add(CropDetector* detector, const uint8_t* luma, int linesize);
+
+// The picture area found so far, with even offsets and sizes for 4:2:0.
+// Returns false when there is nothing worth cropping: no frame had any
+// content, there are no bars, or the area left would be implausibly small.
+bool crop_detector_get(const CropDetector* detector, int* x, int* y, int* width, int* height);
+
+void crop_detector_free(CropDetector** detector);
+
+#endif // CROP_DETECT_H
@@ -0,0 +1,116 @@
+// Checks the bounds crop_detect.h finds on synthetic letterboxed and
+// pillarboxed frames at 8 and 10 bits, and the cases where it must not crop.
+// Build and run from the repository root:
+//
+//   g++ -std=c++17 -O2 code/crop_detect_test.cpp code/crop_detect.cpp -o crop_detect_test
+//   ./crop_detect_test
+
+#include "crop_detect.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static std::mt19937 rng(777);
+static int failures = 0;
+
+struct Rect {
+    int x, y, width, height;
+};
+
+// A luma plane of noisy limited-range black with `picture` filled with
+// content of the given 8-bit mean level
+class TestFrame {
+public:
+    TestFrame(int width, int height, int bit_depth)
+        : width_(width), height_(height), bit_depth_(bit_depth),
+          linesize_(width * (bit_depth > 8 ? 2 : 1) + 64),
+          data_((size_t)linesize_ * height) {}
+
+    void paint(const Rect& picture, int level) {
+        for (int y = 0; y < height_; y++) {
+            for (int x = 0; x < width_; x++) {
+                bool inside = x >= picture.x && x < picture.x + picture.width && y >= picture.y &&
+                    y < picture.y + picture.height;
+                int v = inside ? level - 20 + (int)(rng() % 41) : 16 + (int)(rng() % 3);
+                set(x, y, v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+        }
+    }
+
+    const uint8_t* data() const { return data_.data(); }
+    int linesize() const { return linesize_; }
+
+private:
+    void set(int x, int y, int v8) {
+        uint8_t* row = data_.data() + (size_t)y * linesize_;
+        if (bit_depth_ > 8)
+            ((uint16_t*)row)[x] = (uint16_t)(v8 << (bit_depth_ - 8));
+        else
+            row[x] = (uint8_t)v8;
+    }
+
+    int width_, height_, bit_depth_, linesize_;
+    std::vector<uint8_t> data_;
+};
+
+// Adds one frame per picture rectangle and returns what the detector found
+static bool detect(int width, int height, int bit_depth, const std::vector<Rect>& pictures, int level,
+                   Rect* crop) {
+    CropDetector* detector = crop_detector_create(width, height, bit_depth);
+    TestFrame frame(width, height, bit_depth);
+    for (const Rect& picture : pictures) {
+        frame.paint(picture, level);
+        crop_detector_add(detector, frame.data(), frame.linesize());
+    }
+    bool found = crop_detector_get(detector, &crop->x, &crop->y, &crop->width, &crop->height);
+    crop_detector_free(&detector);
+    return found;
+}
+
+static void expect_crop(const char* what, int width, int height, int bit_depth,
+                        const std::vector<Rect>& pictures, const Rect& expected) {
+    Rect crop = {0, 0, 0, 0};
+    if (!detect(width, height, bit_depth, pictures, 128, &crop) || crop.x != expected.x ||
+        crop.y != expected.y || crop.width != expected.width || crop.height != expected.height) {
+        fprintf(stderr, "FAIL %s %d-bit: got %d,%d %dx%d, expected %d,%d %dx%d\n", what, bit_depth, crop.x,
+                crop.y, crop.width, crop.height, expected.x, expected.y, expected.width, expected.height);
+        failures++;
+    }
+}
+
+static void expect_no_crop(const char* what, int width, int height, int bit_depth,
+                           const std::vector<Rect>& pictures, int level) {
+    Rect crop;
+    if (detect(width, height, bit_depth, pictures, level, &crop)) {
+        fprintf(stderr, "FAIL %s %d-bit: cropped to %d,%d %dx%d\n", what, bit_depth, crop.x, crop.y, crop.width,
+                crop.height);
+        failures++;
+    }
+}
+
+int main() {
+    for (int depth : {8, 10}) {
+        // 2.39:1 film in 1080p, with an odd width; edges round outwards to even
+        expect_crop("letterbox", 1921, 1080, depth, {{0, 139, 1921, 802}}, {0, 138, 1920, 804});
+        // 4:3 in 16:9
+        expect_crop("pillarbox", 1920, 1080, depth, {{240, 0, 1440, 1080}}, {240, 0, 1440, 1080});
+        // Both, with the picture moving between samples: the union is kept
+        expect_crop("windowbox", 1921, 1080, depth,
+                    {{241, 139, 1439, 802}, {241, 140, 1439, 802}, {241, 141, 1439, 800}},
+                    {240, 138, 1440, 804});
+        // Odd-sized frame, bars on one side only
+        expect_crop("bottom bar", 721, 481, depth, {{0, 0, 721, 401}}, {0, 0, 720, 402});
+
+        expect_no_crop("full frame", 1920, 1080, depth, {{0, 0, 1920, 1080}}, 128);
+        expect_no_crop("all black", 1920, 1080, depth, {{0, 0, 0, 0}}, 128);
+        // A small lit area in an otherwise dark frame is not a letterbox
+        expect_no_crop("small picture", 1920, 1080, depth, {{800, 400, 320, 280}}, 128);
+        // Content under the black limit is not content
+        expect_no_crop("dark picture", 1920, 1080, depth, {{0, 139, 1920, 802}}, 20);
+    }
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#include "duplicate_detect.h"
+
+#include "luma_reduce.h"
+
+#include <vector>
+
+struct DuplicateDetector {
+    int threshold;
+    int max_run;
+    int width;                 // Size of the reduced plane
+    int height;
+    std::vector<uint8_t> kept; // Reduced plane of the last frame kept
+    std::vector<uint8_t> cur;
+    bool have_kept;
+    int run;                   // Duplicates since the last frame kept
+};
+
+DuplicateDetector* duplicate_detector_create(int threshold, int max_run) {
+    DuplicateDetector* detector = new DuplicateDetector();
+    detector->threshold = threshold;
+    detector->max_run = max_run;
+    detector->width = 0;
+    detector->height = 0;
+    detector->have_kept = false;
+    detector->run = 0;
+    return detector;
+}
+
+bool duplicate_detector_is_duplicate(DuplicateDetector* detector, const uint8_t* luma, int linesize,
+                                     int width, int height, int bit_depth) {
+    int out_w = width / kLumaBlockSize;
+    int out_h = height / kLumaBlockSize;
+    if (out_w <= 0 || out_h <= 0)
+        return false;
+    // A resolution change is never a duplicate
+    if (out_w != detector->width || out_h != detector->height) {
+        detector->width = out_w;
+        detector->height = out_h;
+        detector->kept.assign((size_t)out_w * out_h, 0);
+        detector->cur.assign((size_t)out_w * out_h, 0);
+        detector->have_kept = false;
+    }
+    luma_reduce_blocks(luma, linesize, width, height, bit_depth, detector->cur.data());
+    if (detector->have_kept && detector->run < detector->max_run &&
+        luma_max_abs_diff(detector->cur.data(), detector->kept.data(), detector->kept.size()) <=
+            detector->threshold) {
+        detector->run++;
+        return true;
+    }
+    detector->kept.swap(detector->cur);
+    detector->have_kept = true;
+    detector->run = 0;
+    return false;
+}
+
+void duplicate_detector_free(DuplicateDetector** detector) {
+    delete *detector;
+    *detector = nullptr;
+}
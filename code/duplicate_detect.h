@@ -0,0 +1,28 @@
+#ifndef DUPLICATE_DETECT_H
+#define DUPLICATE_DETECT_H
+
+#include <cstdint>
+
+struct DuplicateDetector;
+
+// Finds frames that repeat the last one kept: slides, lecture recordings,
+// paused screen captures. Frames are compared as 8x8 block averages
+// (luma_reduce.h), and a frame is a duplicate while no block's mean luma
+// has moved by more than the threshold. Looking at the largest block change
+// rather than the average keeps small but real changes, like a new bullet
+// point or a moving pointer.
+
+// `threshold` is the largest block change, in 8-bit luma levels, still
+// counted as a duplicate. At most `max_run` duplicates in a row are reported
+// before a frame is kept again regardless.
+DuplicateDetector* duplicate_detector_create(int threshold, int max_run);
+
+// Returns true when the luma plane repeats the last frame kept; otherwise the
+// frame becomes the one later frames are compared with. `bit_depth` above 8
+// means 16-bit little-endian samples of that depth (up to 15 bits).
+bool duplicate_detector_is_duplicate(DuplicateDetector* detector, const uint8_t* luma, int linesize,
+                                     int width, int height, int bit_depth);
+
+void duplicate_detector_free(DuplicateDetector** detector);
+
+#endif // DUPLICATE_DETECT_H
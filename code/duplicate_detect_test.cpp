@@ -0,0 +1,135 @@
+// Checks duplicate_detect.h: the block change threshold, comparison with the
+// last frame kept rather than the previous one, the cap on runs of
+// duplicates, resolution changes and 10-bit input. Build (one command) and
+// run from the repository root:
+//
+//   g++ -std=c++17 -O2 -o duplicate_detect_test code/duplicate_detect_test.cpp
+//       code/duplicate_detect.cpp code/luma_reduce.cpp
+//   ./duplicate_detect_test
+
+#include "duplicate_detect.h"
+#include "luma_reduce.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::mt19937 rng(99);
+static int failures = 0;
+
+// A luma plane with room for 16-bit samples and padded rows
+struct Plane {
+    int width, height, bit_depth, linesize;
+    std::vector<uint8_t> data;
+
+    Plane(int w, int h, int depth)
+        : width(w), height(h), bit_depth(depth), linesize(w * (depth > 8 ? 2 : 1) + 32),
+          data((size_t)linesize * h) {
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                set(x, y, 64 + (int)(rng() % 128));
+    }
+
+    int get(int x, int y) const {
+        const uint8_t* row = data.data() + (size_t)y * linesize;
+        return bit_depth > 8 ? ((const uint16_t*)row)[x] >> (bit_depth - 8) : row[x];
+    }
+
+    void set(int x, int y, int v8) {
+        uint8_t* row = data.data() + (size_t)y * linesize;
+        if (bit_depth > 8)
+            ((uint16_t*)row)[x] = (uint16_t)(v8 << (bit_depth - 8));
+        else
+            row[x] = (uint8_t)v8;
+    }
+
+    // Moves the mean of one 8x8 block by `delta` 8-bit levels
+    void shift_block(int bx, int by, int delta) {
+        for (int y = by * kLumaBlockSize; y < (by + 1) * kLumaBlockSize; y++)
+            for (int x = bx * kLumaBlockSize; x < (bx + 1) * kLumaBlockSize; x++)
+                set(x, y, get(x, y) + delta);
+    }
+};
+
+static bool is_duplicate(DuplicateDetector* detector, const Plane& plane) {
+    return duplicate_detector_is_duplicate(detector, plane.data.data(), plane.linesize, plane.width,
+                                           plane.height, plane.bit_depth);
+}
+
+// Feeds `frames` and compares the verdicts with `expected`, "K" for a frame
+// kept and "D" for a duplicate
+static void expect_pattern(const char* what, DuplicateDetector* detector, const std::vector<Plane*>& frames,
+                           const char* expected) {
+    std::string got;
+    for (const Plane* frame : frames)
+        got += is_duplicate(detector, *frame) ? 'D' : 'K';
+    if (got != expected) {
+        fprintf(stderr, "FAIL %s: got %s, expected %s\n", what, got.c_str(), expected);
+        failures++;
+    }
+}
+
+static void check_threshold(int bit_depth) {
+    DuplicateDetector* detector = duplicate_detector_create(3, 100);
+    Plane base(320, 240, bit_depth);
+    Plane small = base, large = base;
+    small.shift_block(5, 7, 3);   // At the threshold: still a repeat
+    large.shift_block(39, 29, 4); // One block past it: a real change
+    expect_pattern(bit_depth > 8 ? "threshold 10-bit" : "threshold", detector,
+                   {&base, &base, &small, &base, &large, &large, &base}, "KDDDKDK");
+    duplicate_detector_free(&detector);
+}
+
+static void check_drift() {
+    // Each frame moves one block by a single level. Compared with the
+    // previous frame every change is under the threshold; compared with the
+    // last frame kept the drift adds up until it passes it.
+    DuplicateDetector* detector = duplicate_detector_create(3, 100);
+    std::vector<Plane> planes;
+    planes.emplace_back(64, 64, 8);
+    for (int i = 1; i < 10; i++) {
+        planes.push_back(planes.back());
+        planes.back().shift_block(2, 2, 1);
+    }
+    std::vector<Plane*> frames;
+    for (Plane& plane : planes)
+        frames.push_back(&plane);
+    expect_pattern("drift", detector, frames, "KDDDKDDDKD");
+    duplicate_detector_free(&detector);
+}
+
+static void check_run_cap() {
+    // A still picture keeps one frame in every max_run + 1
+    DuplicateDetector* detector = duplicate_detector_create(3, 5);
+    Plane still(320, 240, 8);
+    std::vector<Plane*> frames(20, &still);
+    expect_pattern("run cap", detector, frames, "KDDDDDKDDDDDKDDDDDKD");
+    duplicate_detector_free(&detector);
+
+    detector = duplicate_detector_create(3, 0);
+    expect_pattern("no runs", detector, {&still, &still, &still}, "KKK");
+    duplicate_detector_free(&detector);
+}
+
+static void check_resolution_change() {
+    DuplicateDetector* detector = duplicate_detector_create(255, 100);
+    Plane large(320, 240, 8), small(160, 120, 8), tiny(7, 7, 8);
+    // Even the largest threshold does not match across sizes; frames under
+    // one block are never duplicates
+    expect_pattern("resolution change", detector, {&large, &large, &small, &small, &large, &tiny, &tiny},
+                   "KDKDKKK");
+    duplicate_detector_free(&detector);
+}
+
+int main() {
+    check_threshold(8);
+    check_threshold(10);
+    check_drift();
+    check_run_cap();
+    check_resolution_change();
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
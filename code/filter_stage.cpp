@@ -0,0 +1,195 @@
+#include "filter_stage.h"
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/mem.h>
+}
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+
+struct FilterStage {
+    std::string description;
+    int threads;
+    AVFilterGraph* graph;
+    AVFilterContext* source;
+    AVFilterContext* sink;
+    // Input the current graph was configured for
+    int width;
+    int height;
+    int format;
+    AVRational sample_aspect_ratio;
+    AVRational time_base;
+    AVRational frame_rate;
+    // Frames drained from a graph replaced after an input change
+    std::deque<AVFrame*> pending;
+};
+
+static void free_graph(FilterStage* stage) {
+    avfilter_graph_free(&stage->graph);
+    stage->source = nullptr;
+    stage->sink = nullptr;
+}
+
+static int build_graph(FilterStage* stage) {
+    AVFilterInOut* inputs = nullptr;
+    AVFilterInOut* outputs = nullptr;
+    char args[256];
+    int ret;
+
+    stage->graph = avfilter_graph_alloc();
+    if (!stage->graph)
+        return AVERROR(ENOMEM);
+    // Slice threading, within the job's thread budget
+    stage->graph->nb_threads = stage->threads;
+
+    AVRational sar = stage->sample_aspect_ratio.num ? stage->sample_aspect_ratio : av_make_q(1, 1);
+    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+             stage->width, stage->height, stage->format, stage->time_base.num, stage->time_base.den,
+             sar.num, sar.den);
+    if (stage->frame_rate.num && stage->frame_rate.den) {
+        size_t length = strlen(args);
+        snprintf(args + length, sizeof(args) - length, ":frame_rate=%d/%d", stage->frame_rate.num,
+                 stage->frame_rate.den);
+    }
+    ret = avfilter_graph_create_filter(&stage->source, avfilter_get_by_name("buffer"), "in", args, nullptr,
+                                       stage->graph);
+    if (ret >= 0)
+        ret = avfilter_graph_create_filter(&stage->sink, avfilter_get_by_name("buffersink"), "out", nullptr,
+                                           nullptr, stage->graph);
+    if (ret < 0)
+        goto done;
+
+    // The user's chain goes between "in" and "out"
+    outputs = avfilter_inout_alloc();
+    inputs = avfilter_inout_alloc();
+    if (!outputs || !inputs) {
+        ret = AVERROR(ENOMEM);
+        goto done;
+    }
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = stage->source;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = stage->sink;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+    ret = avfilter_graph_parse_ptr(stage->graph, stage->description.c_str(), &inputs, &outputs, nullptr);
+    if (ret >= 0)
+        ret = avfilter_graph_config(stage->graph, nullptr);
+
+done:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret < 0)
+        free_graph(stage);
+    return ret;
+}
+
+FilterStage* filter_stage_open(const char* description, int threads, int width, int height, int format,
+                               AVRational sample_aspect_ratio, AVRational time_base,
+                               AVRational frame_rate) {
+    FilterStage* stage = new FilterStage();
+    stage->description = description;
+    stage->threads = threads;
+    stage->graph = nullptr;
+    stage->source = nullptr;
+    stage->sink = nullptr;
+    stage->width = width;
+    stage->height = height;
+    stage->format = format;
+    stage->sample_aspect_ratio = sample_aspect_ratio;
+    stage->time_base = time_base;
+    stage->frame_rate = frame_rate;
+    if (build_graph(stage) < 0) {
+        fprintf(stderr, "Could not set up the filter graph '%s'\n", description);
+        delete stage;
+        return nullptr;
+    }
+    return stage;
+}
+
+void filter_stage_output(const FilterStage* stage, int* width, int* height, int* format,
+                         AVRational* sample_aspect_ratio, AVRational* time_base, AVRational* frame_rate) {
+    *width = av_buffersink_get_w(stage->sink);
+    *height = av_buffersink_get_h(stage->sink);
+    *format = av_buffersink_get_format(stage->sink);
+    *sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(stage->sink);
+    *time_base = av_buffersink_get_time_base(stage->sink);
+    *frame_rate = av_buffersink_get_frame_rate(stage->sink);
+    if (!frame_rate->num || !frame_rate->den)
+        *frame_rate = av_make_q(0, 1);
+}
+
+// The buffer source only takes frames like the one it was configured for.
+// Flush the old graph into `pending` and configure a new one for the new
+// input; the filters restart from scratch, as they would in ffmpeg.
+static int rebuild_graph(FilterStage* stage, const AVFrame* frame) {
+    int ret = av_buffersrc_add_frame(stage->source, nullptr);
+    while (ret >= 0) {
+        AVFrame* filtered = av_frame_alloc();
+        if (!filtered)
+            return AVERROR(ENOMEM);
+        ret = av_buffersink_get_frame(stage->sink, filtered);
+        if (ret < 0) {
+            av_frame_free(&filtered);
+            break;
+        }
+        stage->pending.push_back(filtered);
+    }
+    if (ret != AVERROR_EOF && ret != AVERROR(EAGAIN))
+        return ret;
+
+    free_graph(stage);
+    stage->width = frame->width;
+    stage->height = frame->height;
+    stage->format = frame->format;
+    stage->sample_aspect_ratio = frame->sample_aspect_ratio;
+    ret = build_graph(stage);
+    if (ret < 0)
+        fprintf(stderr, "Could not set up the filter graph for %dx%d input\n", frame->width, frame->height);
+    return ret;
+}
+
+int filter_stage_push(FilterStage* stage, AVFrame* frame) {
+    if (frame && (frame->width != stage->width || frame->height != stage->height ||
+                  frame->format != stage->format)) {
+        int ret = rebuild_graph(stage, frame);
+        if (ret < 0)
+            return ret;
+    }
+    if (!stage->graph)
+        return AVERROR(EINVAL);
+    return av_buffersrc_add_frame_flags(stage->source, frame, 0);
+}
+
+int filter_stage_pull(FilterStage* stage, AVFrame* frame) {
+    if (!stage->pending.empty()) {
+        AVFrame* filtered = stage->pending.front();
+        stage->pending.pop_front();
+        av_frame_move_ref(frame, filtered);
+        av_frame_free(&filtered);
+        return 0;
+    }
+    if (!stage->graph)
+        return AVERROR_EOF;
+    return av_buffersink_get_frame(stage->sink, frame);
+}
+
+void filter_stage_close(FilterStage** stage) {
+    FilterStage* s = *stage;
+    if (!s)
+        return;
+    for (AVFrame* frame : s->pending)
+        av_frame_free(&frame);
+    free_graph(s);
+    delete s;
+    *stage = nullptr;
+}
@@ -0,0 +1,36 @@
+#ifndef FILTER_STAGE_H
+#define FILTER_STAGE_H
+
+struct AVFrame;
+struct AVRational;
+struct FilterStage;
+
+// A libavfilter graph between the decoder and the encoder, for preprocessing
+// that used to take separate ffmpeg passes (deinterlacing, denoising, logo
+// overlays...) with intermediate files. Frames pass through by reference.
+// The graph is described in ffmpeg's -vf syntax, e.g. "bwdif,hqdn3d", and is
+// rebuilt in place when the input changes resolution or pixel format.
+
+// `threads` bounds the graph's slice threading, 0 for one per core. Returns
+// nullptr if the graph cannot be parsed or configured.
+FilterStage* filter_stage_open(const char* description, int threads, int width, int height, int format,
+                               AVRational sample_aspect_ratio, AVRational time_base,
+                               AVRational frame_rate);
+
+// Properties of the frames the graph puts out. `frame_rate` is 0/1 when the
+// graph does not know it.
+void filter_stage_output(const FilterStage* stage, int* width, int* height, int* format,
+                         AVRational* sample_aspect_ratio, AVRational* time_base, AVRational* frame_rate);
+
+// Hands a frame's reference over to the graph, leaving `frame` blank;
+// nullptr signals the end of the input. Returns 0 or a negative AVERROR code.
+int filter_stage_push(FilterStage* stage, AVFrame* frame);
+
+// Takes the next filtered frame. Returns 0, AVERROR(EAGAIN) when the graph
+// needs more input, AVERROR_EOF once everything has been returned, or another
+// negative AVERROR code.
+int filter_stage_pull(FilterStage* stage, AVFrame* frame);
+
+void filter_stage_close(FilterStage** stage);
+
+#endif // FILTER_STAGE_H
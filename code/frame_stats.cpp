@@ -0,0 +1,96 @@
+#include "frame_stats.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
+}
+
+#include <cstdio>
+#include <map>
+
+static const size_t kFileBufferSize = 64 * 1024;
+
+struct FrameStatsWriter {
+    FILE* file;
+    AVRational time_base;
+    std::map<int64_t, int64_t> sent_us; // pts -> time the frame went into the encoder
+    int error;
+};
+
+static char pict_type_char(int pict_type) {
+    switch (pict_type) {
+    case AV_PICTURE_TYPE_I:
+        return 'I';
+    case AV_PICTURE_TYPE_P:
+        return 'P';
+    case AV_PICTURE_TYPE_B:
+        return 'B';
+    default:
+        return '?';
+    }
+}
+
+FrameStatsWriter* frame_stats_open(const char* path, int time_base_num, int time_base_den) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not open frame stats file '%s'\n", path);
+        return nullptr;
+    }
+    setvbuf(file, nullptr, _IOFBF, kFileBufferSize);
+    fputs("pts_time,dts_time,type,key,size,qp,latency_us\n", file);
+    FrameStatsWriter* writer = new FrameStatsWriter();
+    writer->file = file;
+    writer->time_base = AVRational{time_base_num, time_base_den};
+    writer->error = 0;
+    return writer;
+}
+
+void frame_stats_frame_sent(FrameStatsWriter* writer, int64_t pts) {
+    if (pts != AV_NOPTS_VALUE)
+        writer->sent_us[pts] = av_gettime_relative();
+}
+
+int frame_stats_packet(FrameStatsWriter* writer, const AVPacket* pkt) {
+    if (writer->error < 0)
+        return writer->error;
+    int64_t now = av_gettime_relative();
+    int64_t latency = -1;
+    auto it = writer->sent_us.find(pkt->pts);
+    if (it != writer->sent_us.end()) {
+        latency = now - it->second;
+        writer->sent_us.erase(it);
+    }
+    // Frames the encoder dropped never come back; nothing still pending can
+    // have a pts below the dts of a packet coming out now
+    while (!writer->sent_us.empty() && writer->sent_us.begin()->first < pkt->dts)
+        writer->sent_us.erase(writer->sent_us.begin());
+
+    size_t size = 0;
+    const uint8_t* stats = av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_STATS, &size);
+    int pict_type = AV_PICTURE_TYPE_NONE;
+    double qp = -1;
+    if (stats && size >= 5) {
+        uint32_t quality = stats[0] | (stats[1] << 8) | (stats[2] << 16) | ((uint32_t)stats[3] << 24);
+        qp = (double)quality / FF_QP2LAMBDA;
+        pict_type = stats[4];
+    }
+
+    double tb = av_q2d(writer->time_base);
+    if (fprintf(writer->file, "%.6f,%.6f,%c,%d,%d,%.2f,%lld\n", pkt->pts * tb, pkt->dts * tb,
+                pict_type_char(pict_type), (pkt->flags & AV_PKT_FLAG_KEY) ? 1 : 0, pkt->size, qp,
+                (long long)latency) < 0)
+        writer->error = AVERROR(EIO);
+    return writer->error;
+}
+
+int frame_stats_close(FrameStatsWriter** writer) {
+    FrameStatsWriter* w = *writer;
+    if (!w)
+        return 0;
+    int ret = w->error;
+    if (fclose(w->file) != 0 && ret >= 0)
+        ret = AVERROR(EIO);
+    delete w;
+    *writer = nullptr;
+    return ret;
+}
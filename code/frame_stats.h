@@ -0,0 +1,33 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <cstdint>
+
+struct AVPacket;
+struct FrameStatsWriter;
+
+// Per-frame encoder statistics streamed to a CSV file as the encode loop
+// receives packets, one line per packet in output (decode) order:
+//
+//   pts_time,dts_time,type,key,size,qp,latency_us
+//
+// `type` is I, P, B or ? and `qp` the frame's average QP, both as reported in
+// the encoder's quality-stats side data. `latency_us` is the time from sending
+// the frame to receiving its packet, so it includes the encoder's lookahead and
+// frame-thread pipeline delay, not just the work on that frame.
+
+// Creates the file and writes the header line. Returns nullptr on failure.
+FrameStatsWriter* frame_stats_open(const char* path, int time_base_num, int time_base_den);
+
+// Notes when the frame with encoder timestamp `pts` was sent to the encoder.
+void frame_stats_frame_sent(FrameStatsWriter* writer, int64_t pts);
+
+// Writes the line for `pkt`, whose timestamps are in the encoder's time base.
+// Returns 0 or a negative AVERROR code.
+int frame_stats_packet(FrameStatsWriter* writer, const AVPacket* pkt);
+
+// Flushes and closes the file and frees `writer`. Returns 0 or a negative
+// AVERROR code.
+int frame_stats_close(FrameStatsWriter** writer);
+
+#endif // FRAME_STATS_H
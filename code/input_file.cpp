@@ -0,0 +1,48 @@
+#include "input_file.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "async_io.h"
+#include "mmap_input.h"
+
+#include <cstdio>
+#include <cstring>
+
+static void close_input_io(AVIOContext** pb, int async_io) {
+    if (async_io)
+        async_input_close(pb);
+    else
+        mmap_input_close(pb);
+}
+
+int input_file_open(const char* path, int async_io, AVDictionary** options, AVFormatContext** fmt_ctx,
+                    AVIOContext** pb) {
+    // "-" reads from standard input, matching the usual command-line convention
+    const char* url = strcmp(path, "-") == 0 ? "pipe:0" : path;
+    *fmt_ctx = nullptr;
+    *pb = async_io ? async_input_open(url) : mmap_input_open(url);
+    if (*pb) {
+        *fmt_ctx = avformat_alloc_context();
+        if (!*fmt_ctx) {
+            fprintf(stderr, "Could not allocate input context\n");
+            close_input_io(pb, async_io);
+            return AVERROR(ENOMEM);
+        }
+        (*fmt_ctx)->pb = *pb;
+    }
+    int ret = avformat_open_input(fmt_ctx, url, nullptr, options);
+    if (ret < 0) {
+        // avformat_open_input has freed the context but leaves custom I/O alone
+        fprintf(stderr, "Could not open input file '%s'\n", path);
+        close_input_io(pb, async_io);
+        return ret;
+    }
+    return 0;
+}
+
+void input_file_close(AVFormatContext** fmt_ctx, AVIOContext** pb, int async_io) {
+    avformat_close_input(fmt_ctx);
+    close_input_io(pb, async_io);
+}
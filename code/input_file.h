@@ -0,0 +1,25 @@
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+struct AVDictionary;
+struct AVFormatContext;
+struct AVIOContext;
+
+// Opening inputs for demuxing, shared by the converter and the thumbnailer.
+// "-" reads from standard input. Regular local files are read through our own
+// AVIOContext: prefetched asynchronous reads (async_io.h) when `async_io` is
+// set, a memory mapping (mmap_input.h) otherwise. Anything else (pipes, URLs,
+// devices) is left to FFmpeg's own protocols.
+
+// Opens `path` into `*fmt_ctx`, passing `options` (may be nullptr) to
+// avformat_open_input. `*pb` receives the custom AVIOContext, or nullptr when
+// none is used. Prints a message and returns a negative AVERROR code on
+// failure, with nothing left to free.
+int input_file_open(const char* path, int async_io, AVDictionary** options, AVFormatContext** fmt_ctx,
+                    AVIOContext** pb);
+
+// Closes the demuxer, then the custom AVIOContext opened with the same
+// `async_io`. Safe to call on already closed or never opened inputs.
+void input_file_close(AVFormatContext** fmt_ctx, AVIOContext** pb, int async_io);
+
+#endif // INPUT_FILE_H
@@ -0,0 +1,306 @@
+#include "logo_overlay.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/cpu.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include <cstdio>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define LOGO_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Blend weights are alpha rescaled to a power of two, so the blend ends in a
+// shift: 0-256 for 8-bit output, 0-64 for 10-bit, where 1023 * 64 still fits
+// the 16-bit lanes
+static const int kWeightBits8 = 8;
+static const int kWeightBits10 = 6;
+
+// The logo's part of one frame plane, clipped to the frame
+struct LogoPlane {
+    int x;
+    int y;
+    int width;
+    int height;
+    std::vector<uint16_t> samples;
+    std::vector<uint16_t> weights;
+};
+
+struct LogoOverlay {
+    int frame_width;
+    int frame_height;
+    int format;
+    bool high_bit_depth;
+    LogoPlane planes[3];
+};
+
+// ---------------------------------------------------------------------------
+// Blend kernels: dst = (src * w + dst * (one - w) + one / 2) >> bits
+
+static void blend_row8_c(uint8_t* dst, const uint16_t* src, const uint16_t* weight, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = (uint8_t)((src[i] * weight[i] + dst[i] * (256 - weight[i]) + 128) >> kWeightBits8);
+}
+
+static void blend_row10_c(uint16_t* dst, const uint16_t* src, const uint16_t* weight, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = (uint16_t)((src[i] * weight[i] + dst[i] * (64 - weight[i]) + 32) >> kWeightBits10);
+}
+
+#if LOGO_X86
+// Both products stay below 2^16 and so does their sum, as the weights add up
+// to one; mullo and add are exact on unsigned 16-bit lanes
+TARGET_AVX2 static void blend_row8_avx2(uint8_t* dst, const uint16_t* src, const uint16_t* weight, int n) {
+    const __m256i one = _mm256_set1_epi16(256);
+    const __m256i half = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(dst + i)));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(weight + i));
+        __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(s, w),
+                                       _mm256_mullo_epi16(d, _mm256_sub_epi16(one, w)));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, half), kWeightBits8);
+        // packus works per 128-bit lane; gather both halves into the low lane
+        sum = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0xD8);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_castsi256_si128(sum));
+    }
+    blend_row8_c(dst + i, src + i, weight + i, n - i);
+}
+
+TARGET_AVX2 static void blend_row10_avx2(uint16_t* dst, const uint16_t* src, const uint16_t* weight, int n) {
+    const __m256i one = _mm256_set1_epi16(64);
+    const __m256i half = _mm256_set1_epi16(32);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(weight + i));
+        __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(s, w),
+                                       _mm256_mullo_epi16(d, _mm256_sub_epi16(one, w)));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, half), kWeightBits10);
+        _mm256_storeu_si256((__m256i*)(dst + i), sum);
+    }
+    blend_row10_c(dst + i, src + i, weight + i, n - i);
+}
+#endif // LOGO_X86
+
+struct BlendKernels {
+    void (*row8)(uint8_t* dst, const uint16_t* src, const uint16_t* weight, int n);
+    void (*row10)(uint16_t* dst, const uint16_t* src, const uint16_t* weight, int n);
+};
+
+static BlendKernels select_kernels() {
+    BlendKernels k = { blend_row8_c, blend_row10_c };
+#if LOGO_X86
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        k = BlendKernels{ blend_row8_avx2, blend_row10_avx2 };
+#endif
+    return k;
+}
+
+static const BlendKernels& kernels() {
+    static const BlendKernels k = select_kernels();
+    return k;
+}
+
+// ---------------------------------------------------------------------------
+// Setup
+
+// Decodes the first picture of an image file
+static AVFrame* load_image(const char* path) {
+    AVFormatContext* fmt_ctx = nullptr;
+    AVCodecContext* dec_ctx = nullptr;
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    bool ok = false;
+    int stream_index;
+    const AVCodec* decoder;
+
+    if (!packet || !frame || avformat_open_input(&fmt_ctx, path, nullptr, nullptr) < 0 ||
+        avformat_find_stream_info(fmt_ctx, nullptr) < 0)
+        goto done;
+    stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index < 0)
+        goto done;
+    decoder = avcodec_find_decoder(fmt_ctx->streams[stream_index]->codecpar->codec_id);
+    dec_ctx = decoder ? avcodec_alloc_context3(decoder) : nullptr;
+    if (!dec_ctx || avcodec_parameters_to_context(dec_ctx, fmt_ctx->streams[stream_index]->codecpar) < 0 ||
+        avcodec_open2(dec_ctx, decoder, nullptr) < 0)
+        goto done;
+    while (!ok && av_read_frame(fmt_ctx, packet) >= 0) {
+        if (packet->stream_index == stream_index && avcodec_send_packet(dec_ctx, packet) >= 0)
+            ok = avcodec_receive_frame(dec_ctx, frame) >= 0;
+        av_packet_unref(packet);
+    }
+    if (!ok) {
+        avcodec_send_packet(dec_ctx, nullptr);
+        ok = avcodec_receive_frame(dec_ctx, frame) >= 0;
+    }
+
+done:
+    avcodec_free_context(&dec_ctx);
+    avformat_close_input(&fmt_ctx);
+    av_packet_free(&packet);
+    if (!ok)
+        av_frame_free(&frame);
+    return frame;
+}
+
+// Converts the image to YUV with alpha in the output's bit depth, matrix and range
+static AVFrame* convert_image(const AVFrame* image, bool high_bit_depth, int colorspace, int color_range) {
+    AVFrame* yuva = av_frame_alloc();
+    if (!yuva)
+        return nullptr;
+    yuva->width = image->width;
+    yuva->height = image->height;
+    yuva->format = high_bit_depth ? AV_PIX_FMT_YUVA420P10 : AV_PIX_FMT_YUVA420P;
+    SwsContext* sws_ctx = sws_getContext(image->width, image->height, (enum AVPixelFormat)image->format,
+                                         yuva->width, yuva->height, (enum AVPixelFormat)yuva->format,
+                                         SWS_BICUBIC | SWS_ACCURATE_RND, nullptr, nullptr, nullptr);
+    if (!sws_ctx || av_frame_get_buffer(yuva, 0) < 0) {
+        sws_freeContext(sws_ctx);
+        av_frame_free(&yuva);
+        return nullptr;
+    }
+    // Unspecified output matrices follow swscale's own default
+    int matrix = colorspace == AVCOL_SPC_UNSPECIFIED || colorspace == AVCOL_SPC_RGB ? SWS_CS_DEFAULT :
+        colorspace;
+    // RGB and yuvj images are full range, other YUV only when tagged so
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)image->format);
+    bool full_range_image = image->color_range == AVCOL_RANGE_JPEG ||
+        (desc && (desc->flags & AV_PIX_FMT_FLAG_RGB)) || image->format == AV_PIX_FMT_YUVJ420P ||
+        image->format == AV_PIX_FMT_YUVJ422P || image->format == AV_PIX_FMT_YUVJ444P;
+    sws_setColorspaceDetails(sws_ctx, sws_getCoefficients(SWS_CS_DEFAULT),
+                             full_range_image, sws_getCoefficients(matrix),
+                             color_range == AVCOL_RANGE_JPEG, 0, 1 << 16, 1 << 16);
+    sws_scale(sws_ctx, image->data, image->linesize, 0, image->height, yuva->data, yuva->linesize);
+    sws_freeContext(sws_ctx);
+    return yuva;
+}
+
+static inline int read_sample(const AVFrame* frame, int plane, int x, int y, bool high_bit_depth) {
+    const uint8_t* row = frame->data[plane] + (int64_t)y * frame->linesize[plane];
+    return high_bit_depth ? ((const uint16_t*)row)[x] : row[x];
+}
+
+// Fills a LogoPlane with the part of the logo at (x, y) that falls inside a
+// plane of plane_width x plane_height. `shift` is the plane's subsampling;
+// chroma weights average the alpha samples each chroma sample covers.
+static void build_plane(LogoPlane* plane, const AVFrame* yuva, int index, int x, int y, int shift,
+                        int plane_width, int plane_height, bool high_bit_depth) {
+    int logo_width = (yuva->width + shift) >> shift;
+    int logo_height = (yuva->height + shift) >> shift;
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + logo_width < plane_width ? x + logo_width : plane_width;
+    int y1 = y + logo_height < plane_height ? y + logo_height : plane_height;
+    plane->x = x0;
+    plane->y = y0;
+    plane->width = x1 > x0 ? x1 - x0 : 0;
+    plane->height = y1 > y0 ? y1 - y0 : 0;
+    plane->samples.resize((size_t)plane->width * plane->height);
+    plane->weights.resize((size_t)plane->width * plane->height);
+
+    int alpha_max = high_bit_depth ? 1023 : 255;
+    int weight_one = 1 << (high_bit_depth ? kWeightBits10 : kWeightBits8);
+    for (int r = 0; r < plane->height; r++) {
+        int ly = y0 - y + r;
+        for (int c = 0; c < plane->width; c++) {
+            int lx = x0 - x + c;
+            int alpha = 0;
+            int count = 0;
+            for (int dy = 0; dy <= shift; dy++) {
+                for (int dx = 0; dx <= shift; dx++) {
+                    int ax = (lx << shift) + dx;
+                    int ay = (ly << shift) + dy;
+                    if (ax < yuva->width && ay < yuva->height) {
+                        alpha += read_sample(yuva, 3, ax, ay, high_bit_depth);
+                        count++;
+                    }
+                }
+            }
+            size_t i = (size_t)r * plane->width + c;
+            plane->samples[i] = (uint16_t)read_sample(yuva, index, lx, ly, high_bit_depth);
+            plane->weights[i] = (uint16_t)(((int64_t)alpha * weight_one + (int64_t)count * alpha_max / 2) /
+                                           ((int64_t)count * alpha_max));
+        }
+    }
+}
+
+LogoOverlay* logo_overlay_open(const char* path, int x, int y, int frame_width, int frame_height, int format,
+                               int colorspace, int color_range) {
+    if (format != AV_PIX_FMT_YUV420P && format != AV_PIX_FMT_YUV420P10) {
+        fprintf(stderr, "Logo overlay does not support the output pixel format\n");
+        return nullptr;
+    }
+    AVFrame* image = load_image(path);
+    if (!image) {
+        fprintf(stderr, "Could not read logo image '%s'\n", path);
+        return nullptr;
+    }
+    bool high_bit_depth = format == AV_PIX_FMT_YUV420P10;
+    AVFrame* yuva = convert_image(image, high_bit_depth, colorspace, color_range);
+    if (!yuva) {
+        fprintf(stderr, "Could not convert logo image '%s'\n", path);
+        av_frame_free(&image);
+        return nullptr;
+    }
+
+    // Even positions keep the logo's chroma aligned with the frame's
+    if (x < 0)
+        x += frame_width - yuva->width;
+    if (y < 0)
+        y += frame_height - yuva->height;
+    x &= ~1;
+    y &= ~1;
+
+    LogoOverlay* logo = new LogoOverlay();
+    logo->frame_width = frame_width;
+    logo->frame_height = frame_height;
+    logo->format = format;
+    logo->high_bit_depth = high_bit_depth;
+    build_plane(&logo->planes[0], yuva, 0, x, y, 0, frame_width, frame_height, high_bit_depth);
+    for (int p = 1; p < 3; p++)
+        build_plane(&logo->planes[p], yuva, p, x >> 1, y >> 1, 1, frame_width >> 1, frame_height >> 1,
+                    high_bit_depth);
+    av_frame_free(&yuva);
+    av_frame_free(&image);
+    return logo;
+}
+
+void logo_overlay_apply(const LogoOverlay* logo, AVFrame* frame) {
+    if (frame->width != logo->frame_width || frame->height != logo->frame_height ||
+        frame->format != logo->format)
+        return;
+    const BlendKernels& k = kernels();
+    for (int p = 0; p < 3; p++) {
+        const LogoPlane& plane = logo->planes[p];
+        for (int r = 0; r < plane.height; r++) {
+            uint8_t* row = frame->data[p] + (int64_t)(plane.y + r) * frame->linesize[p];
+            const uint16_t* samples = plane.samples.data() + (size_t)r * plane.width;
+            const uint16_t* weights = plane.weights.data() + (size_t)r * plane.width;
+            if (logo->high_bit_depth)
+                k.row10((uint16_t*)row + plane.x, samples, weights, plane.width);
+            else
+                k.row8(row + plane.x, samples, weights, plane.width);
+        }
+    }
+}
+
+void logo_overlay_free(LogoOverlay** logo) {
+    delete *logo;
+    *logo = nullptr;
+}
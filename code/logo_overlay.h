@@ -0,0 +1,27 @@
+#ifndef LOGO_OVERLAY_H
+#define LOGO_OVERLAY_H
+
+struct AVFrame;
+struct LogoOverlay;
+
+// A static logo (PNG or any other image FFmpeg decodes, with or without
+// alpha) alpha-blended onto the frames about to be encoded. The image is
+// converted once to the output's YUV format, color matrix and range, with
+// blend weights per luma and chroma sample, so each frame costs only a
+// vectorized blend over the logo's area.
+
+// `x` and `y` place the logo's top-left corner on the output frame; negative
+// values count from the right and bottom edges instead (-16 puts the logo 16
+// pixels in from that edge). The logo is clipped to the frame. `format` is
+// yuv420p or yuv420p10, `colorspace` and `color_range` the output's
+// AVColorSpace and AVColorRange. Returns nullptr on failure.
+LogoOverlay* logo_overlay_open(const char* path, int x, int y, int frame_width, int frame_height, int format,
+                               int colorspace, int color_range);
+
+// Blends the logo onto `frame`, which must be writable and of the size and
+// format given at creation
+void logo_overlay_apply(const LogoOverlay* logo, AVFrame* frame);
+
+void logo_overlay_free(LogoOverlay** logo);
+
+#endif // LOGO_OVERLAY_H
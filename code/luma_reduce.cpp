@@ -0,0 +1,128 @@
+#include "luma_reduce.h"
+
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUMA_REDUCE_SSE2 1
+#endif
+
+// Averages the 8x8 blocks of 8-bit `src` into `dst`
+static void reduce_plane(const uint8_t* src, int linesize, int width, int height, uint8_t* dst) {
+    int out_w = width / kLumaBlockSize;
+    int out_h = height / kLumaBlockSize;
+    for (int by = 0; by < out_h; by++) {
+        const uint8_t* rows = src + (int64_t)by * kLumaBlockSize * linesize;
+        uint8_t* out = dst + by * out_w;
+        int bx = 0;
+#if LUMA_REDUCE_SSE2
+        // SAD against zero sums each 8-byte half of a 16-byte load, i.e. two
+        // block rows at a time
+        const __m128i zero = _mm_setzero_si128();
+        for (; bx + 2 <= out_w; bx += 2) {
+            __m128i acc = zero;
+            for (int y = 0; y < kLumaBlockSize; y++) {
+                __m128i px = _mm_loadu_si128((const __m128i*)(rows + y * linesize + bx * kLumaBlockSize));
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(px, zero));
+            }
+            out[bx] = (uint8_t)((_mm_cvtsi128_si32(acc) + 32) >> 6);
+            out[bx + 1] = (uint8_t)((_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)) + 32) >> 6);
+        }
+#endif
+        for (; bx < out_w; bx++) {
+            int sum = 0;
+            for (int y = 0; y < kLumaBlockSize; y++)
+                for (int x = 0; x < kLumaBlockSize; x++)
+                    sum += rows[y * linesize + bx * kLumaBlockSize + x];
+            out[bx] = (uint8_t)((sum + 32) >> 6);
+        }
+    }
+}
+
+// reduce_plane for 16-bit samples, scaled down to 8 bits
+static void reduce_plane16(const uint8_t* src, int linesize, int width, int height, int depth,
+                           uint8_t* dst) {
+    int out_w = width / kLumaBlockSize;
+    int out_h = height / kLumaBlockSize;
+    int shift = 6 + depth - 8;
+    int round = 1 << (shift - 1);
+    for (int by = 0; by < out_h; by++) {
+        const uint8_t* rows = src + (int64_t)by * kLumaBlockSize * linesize;
+        uint8_t* out = dst + by * out_w;
+        int bx = 0;
+#if LUMA_REDUCE_SSE2
+        // A 16-byte load is one block row; madd against ones folds pairs of
+        // samples into 32-bit sums
+        const __m128i ones = _mm_set1_epi16(1);
+        for (; bx < out_w; bx++) {
+            __m128i acc = _mm_setzero_si128();
+            for (int y = 0; y < kLumaBlockSize; y++) {
+                const uint8_t* row = rows + y * linesize + bx * kLumaBlockSize * 2;
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)row), ones));
+            }
+            acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+            acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+            out[bx] = (uint8_t)((_mm_cvtsi128_si32(acc) + round) >> shift);
+        }
+#endif
+        for (; bx < out_w; bx++) {
+            int sum = 0;
+            for (int y = 0; y < kLumaBlockSize; y++) {
+                const uint16_t* row = (const uint16_t*)(rows + y * linesize) + bx * kLumaBlockSize;
+                for (int x = 0; x < kLumaBlockSize; x++)
+                    sum += row[x];
+            }
+            out[bx] = (uint8_t)((sum + round) >> shift);
+        }
+    }
+}
+
+uint64_t luma_sum_abs_diff(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint64_t sad = 0;
+    size_t i = 0;
+#if LUMA_REDUCE_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    sad = (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (; i < n; i++)
+        sad += abs(a[i] - b[i]);
+    return sad;
+}
+
+int luma_max_abs_diff(const uint8_t* a, const uint8_t* b, size_t n) {
+    int max_diff = 0;
+    size_t i = 0;
+#if LUMA_REDUCE_SSE2
+    // |a - b| as the larger of the two saturating differences
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        acc = _mm_max_epu8(acc, _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)));
+    }
+    acc = _mm_max_epu8(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_max_epu8(acc, _mm_srli_si128(acc, 4));
+    acc = _mm_max_epu8(acc, _mm_srli_si128(acc, 2));
+    acc = _mm_max_epu8(acc, _mm_srli_si128(acc, 1));
+    max_diff = _mm_cvtsi128_si32(acc) & 0xff;
+#endif
+    for (; i < n; i++) {
+        int diff = abs(a[i] - b[i]);
+        if (diff > max_diff)
+            max_diff = diff;
+    }
+    return max_diff;
+}
+
+void luma_reduce_blocks(const uint8_t* luma, int linesize, int width, int height, int bit_depth,
+                        uint8_t* dst) {
+    if (bit_depth > 8)
+        reduce_plane16(luma, linesize, width, height, bit_depth, dst);
+    else
+        reduce_plane(luma, linesize, width, height, dst);
+}
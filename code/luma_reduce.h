@@ -0,0 +1,26 @@
+#ifndef LUMA_REDUCE_H
+#define LUMA_REDUCE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Frame comparison helpers shared by the scene and duplicate detectors. Luma
+// is first reduced to 8x8 block averages (1/64 of the pixels), which also
+// filters out grain and noise, and the reduced planes are compared.
+
+// Side of the square blocks luma is averaged over
+static const int kLumaBlockSize = 8;
+
+// Averages the blocks of a luma plane into `dst`, (width / 8) * (height / 8)
+// 8-bit values row by row. `bit_depth` above 8 means 16-bit little-endian
+// samples of that depth (up to 15 bits).
+void luma_reduce_blocks(const uint8_t* luma, int linesize, int width, int height, int bit_depth,
+                        uint8_t* dst);
+
+// Sum of absolute differences of two reduced planes of `n` values
+uint64_t luma_sum_abs_diff(const uint8_t* a, const uint8_t* b, size_t n);
+
+// Largest absolute difference between two reduced planes of `n` values
+int luma_max_abs_diff(const uint8_t* a, const uint8_t* b, size_t n);
+
+#endif // LUMA_REDUCE_H
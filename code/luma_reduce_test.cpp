@@ -0,0 +1,113 @@
+// Checks luma_reduce.h (SSE2 on x86) against plain scalar reference loops:
+// block averages of 8- to 15-bit planes of awkward sizes and padded rows,
+// and the sum and maximum of absolute differences over every tail length.
+// Build and run from the repository root:
+//
+//   g++ -std=c++17 -O2 code/luma_reduce_test.cpp code/luma_reduce.cpp -o luma_reduce_test
+//   ./luma_reduce_test
+
+#include "luma_reduce.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static std::mt19937 rng(4242);
+static int failures = 0;
+
+static void reference_reduce(const uint8_t* luma, int linesize, int width, int height, int bit_depth,
+                             uint8_t* dst) {
+    int shift = 6 + (bit_depth > 8 ? bit_depth - 8 : 0);
+    for (int by = 0; by < height / kLumaBlockSize; by++) {
+        for (int bx = 0; bx < width / kLumaBlockSize; bx++) {
+            int64_t sum = 0;
+            for (int y = by * kLumaBlockSize; y < (by + 1) * kLumaBlockSize; y++) {
+                const uint8_t* row = luma + (size_t)y * linesize;
+                for (int x = bx * kLumaBlockSize; x < (bx + 1) * kLumaBlockSize; x++)
+                    sum += bit_depth > 8 ? ((const uint16_t*)row)[x] : row[x];
+            }
+            dst[by * (width / kLumaBlockSize) + bx] = (uint8_t)((sum + (1 << (shift - 1))) >> shift);
+        }
+    }
+}
+
+static void check_reduce(int width, int height, int bit_depth, bool extremes) {
+    int bytes = bit_depth > 8 ? 2 : 1;
+    int linesize = width * bytes + 32; // Padding the reduction must not read into
+    std::vector<uint8_t> plane((size_t)linesize * height);
+    int max_value = (1 << bit_depth) - 1;
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = plane.data() + (size_t)y * linesize;
+        for (int x = 0; x < width; x++) {
+            int v = extremes ? (rng() & 1) * max_value : (int)(rng() % (max_value + 1));
+            if (bytes == 2)
+                ((uint16_t*)row)[x] = (uint16_t)v;
+            else
+                row[x] = (uint8_t)v;
+        }
+        for (int x = width * bytes; x < linesize; x++)
+            row[x] = 0xFF;
+    }
+    size_t n = (size_t)(width / kLumaBlockSize) * (height / kLumaBlockSize);
+    std::vector<uint8_t> expected(n + 1, 0xA5), actual(n + 1, 0xA5);
+    reference_reduce(plane.data(), linesize, width, height, bit_depth, expected.data());
+    luma_reduce_blocks(plane.data(), linesize, width, height, bit_depth, actual.data());
+    if (expected != actual) {
+        fprintf(stderr, "FAIL luma_reduce_blocks %dx%d %d-bit%s\n", width, height, bit_depth,
+                extremes ? " extremes" : "");
+        failures++;
+    }
+}
+
+static void check_diffs(size_t n) {
+    std::vector<uint8_t> a(n), b(n);
+    for (size_t i = 0; i < n; i++) {
+        a[i] = (uint8_t)rng();
+        b[i] = (uint8_t)rng();
+    }
+    uint64_t sad = 0;
+    int max_diff = 0;
+    for (size_t i = 0; i < n; i++) {
+        int diff = abs(a[i] - b[i]);
+        sad += diff;
+        if (diff > max_diff)
+            max_diff = diff;
+    }
+    if (luma_sum_abs_diff(a.data(), b.data(), n) != sad || luma_sum_abs_diff(b.data(), a.data(), n) != sad) {
+        fprintf(stderr, "FAIL luma_sum_abs_diff n=%zu\n", n);
+        failures++;
+    }
+    if (luma_max_abs_diff(a.data(), b.data(), n) != max_diff ||
+        luma_max_abs_diff(b.data(), a.data(), n) != max_diff) {
+        fprintf(stderr, "FAIL luma_max_abs_diff n=%zu\n", n);
+        failures++;
+    }
+}
+
+int main() {
+    static const int sizes[][2] = {{8, 8}, {16, 8}, {24, 16}, {63, 17}, {129, 71}, {1920, 1080}, {1917, 1079}};
+    static const int depths[] = {8, 10, 12, 15};
+    for (const auto& size : sizes) {
+        for (int depth : depths) {
+            check_reduce(size[0], size[1], depth, false);
+            check_reduce(size[0], size[1], depth, true);
+        }
+    }
+
+    for (size_t n = 0; n <= 100; n++)
+        check_diffs(n);
+    // The reduced plane of an 8K frame
+    check_diffs((7680 / kLumaBlockSize) * (4320 / kLumaBlockSize));
+
+    // Saturated input: every difference is 255
+    std::vector<uint8_t> zeros(518400, 0), full(518400, 255);
+    if (luma_sum_abs_diff(zeros.data(), full.data(), zeros.size()) != 255ull * zeros.size() ||
+        luma_max_abs_diff(zeros.data(), full.data(), zeros.size()) != 255) {
+        fprintf(stderr, "FAIL saturated differences\n");
+        failures++;
+    }
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
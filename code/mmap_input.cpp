@@ -0,0 +1,199 @@
+#include "mmap_input.h"
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/mem.h>
+}
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Size of the buffer the demuxer reads through. Refills are memcpy's out of the
+// mapping, so this only needs to be large enough to amortise the callback.
+static const int kAvioBufferSize = 256 * 1024;
+
+// How far ahead of the read position the kernel is asked to fault pages in.
+static const int64_t kReadAheadWindow = 16 * 1024 * 1024;
+
+struct MappedFile {
+    const uint8_t* data;
+    int64_t size;
+    int64_t pos;
+    int64_t advised_until; // End of the range already hinted with MADV_WILLNEED
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static void advise_read_ahead(MappedFile* mf) {
+#if !defined(_WIN32)
+    // Re-issue the hint once the reader is half way through the last window
+    if (mf->pos + kReadAheadWindow / 2 < mf->advised_until)
+        return;
+    static const int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t start = mf->pos & ~(page_size - 1);
+    int64_t end = mf->pos + kReadAheadWindow;
+    if (end > mf->size)
+        end = mf->size;
+    if (end > start)
+        madvise((void*)(mf->data + start), (size_t)(end - start), MADV_WILLNEED);
+    mf->advised_until = end;
+#else
+    (void)mf;
+#endif
+}
+
+static int mapped_read(void* opaque, uint8_t* buf, int buf_size) {
+    MappedFile* mf = (MappedFile*)opaque;
+    int64_t remaining = mf->size - mf->pos;
+    if (remaining <= 0)
+        return AVERROR_EOF;
+    int n = remaining < buf_size ? (int)remaining : buf_size;
+    advise_read_ahead(mf);
+    memcpy(buf, mf->data + mf->pos, n);
+    mf->pos += n;
+    return n;
+}
+
+static int64_t mapped_seek(void* opaque, int64_t offset, int whence) {
+    MappedFile* mf = (MappedFile*)opaque;
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return mf->size;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = mf->pos + offset;
+        break;
+    case SEEK_END:
+        pos = mf->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+    mf->pos = pos > mf->size ? mf->size : pos;
+    // A jump invalidates the read-ahead window; hint again from the new position
+    mf->advised_until = mf->pos;
+    return mf->pos;
+}
+
+static void unmap_file(MappedFile* mf) {
+#if defined(_WIN32)
+    if (mf->data)
+        UnmapViewOfFile(mf->data);
+    if (mf->mapping)
+        CloseHandle(mf->mapping);
+    if (mf->file != INVALID_HANDLE_VALUE)
+        CloseHandle(mf->file);
+#else
+    if (mf->data)
+        munmap((void*)mf->data, (size_t)mf->size);
+#endif
+    delete mf;
+}
+
+static MappedFile* map_file(const char* path) {
+    MappedFile* mf = new MappedFile();
+#if defined(_WIN32)
+    mf->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mf->file == INVALID_HANDLE_VALUE || GetFileType(mf->file) != FILE_TYPE_DISK) {
+        unmap_file(mf);
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mf->file, &size) || size.QuadPart <= 0 ||
+        (uint64_t)size.QuadPart > (uint64_t)SIZE_MAX) {
+        unmap_file(mf);
+        return nullptr;
+    }
+    mf->size = size.QuadPart;
+    mf->mapping = CreateFileMappingA(mf->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mf->mapping) {
+        unmap_file(mf);
+        return nullptr;
+    }
+    mf->data = (const uint8_t*)MapViewOfFile(mf->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mf->data) {
+        unmap_file(mf);
+        return nullptr;
+    }
+#else
+    // Pipes, devices and empty files go through the regular protocol handlers.
+    // Check before opening: opening a FIFO blocks until a writer connects, and
+    // the writer would then see this reader go away.
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+        delete mf;
+        return nullptr;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        delete mf;
+        return nullptr;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        (uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+        close(fd);
+        delete mf;
+        return nullptr;
+    }
+    void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (data == MAP_FAILED) {
+        delete mf;
+        return nullptr;
+    }
+    mf->data = (const uint8_t*)data;
+    mf->size = st.st_size;
+    // Demuxing is a front-to-back scan: ask for aggressive read-ahead and early reclaim
+    madvise(data, (size_t)mf->size, MADV_SEQUENTIAL);
+#endif
+    return mf;
+}
+
+AVIOContext* mmap_input_open(const char* path) {
+    MappedFile* mf = map_file(path);
+    if (!mf)
+        return nullptr;
+
+    unsigned char* buffer = (unsigned char*)av_malloc(kAvioBufferSize);
+    if (!buffer) {
+        unmap_file(mf);
+        return nullptr;
+    }
+    AVIOContext* pb = avio_alloc_context(buffer, kAvioBufferSize, 0, mf,
+                                         mapped_read, nullptr, mapped_seek);
+    if (!pb) {
+        av_free(buffer);
+        unmap_file(mf);
+        return nullptr;
+    }
+    return pb;
+}
+
+void mmap_input_close(AVIOContext** pb) {
+    if (!pb || !*pb)
+        return;
+    MappedFile* mf = (MappedFile*)(*pb)->opaque;
+    // avio may have swapped the buffer for a larger one, so free whatever it holds now
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+    unmap_file(mf);
+}
@@ -0,0 +1,17 @@
+#ifndef MMAP_INPUT_H
+#define MMAP_INPUT_H
+
+struct AVIOContext;
+
+// Maps a regular local file into memory and wraps it in an AVIOContext so the
+// demuxer reads straight out of the page cache instead of issuing a read()
+// syscall for every refill of the AVIO buffer.
+// Returns nullptr when the path is not a regular file or cannot be mapped; the
+// caller should then let avformat_open_input open the path itself.
+AVIOContext* mmap_input_open(const char* path);
+
+// Frees an AVIOContext returned by mmap_input_open and unmaps the file.
+// Must be called after avformat_close_input, which leaves custom I/O alone.
+void mmap_input_close(AVIOContext** pb);
+
+#endif // MMAP_INPUT_H
@@ -0,0 +1,86 @@
+#include "packet_index.h"
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+#include <cstdio>
+#include <cstring>
+
+static const int kHeaderSize = 16;
+static const int kRecordSize = 32;
+
+// Records are small and written one per packet; buffer a good number of them
+static const size_t kFileBufferSize = 64 * 1024;
+
+struct PacketIndexWriter {
+    FILE* file;
+    int error;
+};
+
+static void put_le16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++)
+        p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static void put_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++)
+        p[i] = (v >> (8 * i)) & 0xff;
+}
+
+PacketIndexWriter* packet_index_open(const char* path, int time_base_num, int time_base_den) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open packet index '%s'\n", path);
+        return nullptr;
+    }
+    setvbuf(file, nullptr, _IOFBF, kFileBufferSize);
+    uint8_t header[kHeaderSize];
+    memcpy(header, "VIDX", 4);
+    put_le16(header + 4, 1);
+    put_le16(header + 6, kRecordSize);
+    put_le32(header + 8, (uint32_t)time_base_num);
+    put_le32(header + 12, (uint32_t)time_base_den);
+    if (fwrite(header, 1, kHeaderSize, file) != kHeaderSize) {
+        fprintf(stderr, "Could not write packet index '%s'\n", path);
+        fclose(file);
+        return nullptr;
+    }
+    PacketIndexWriter* writer = new PacketIndexWriter();
+    writer->file = file;
+    writer->error = 0;
+    return writer;
+}
+
+int packet_index_add(PacketIndexWriter* writer, const PacketIndexEntry* entry) {
+    if (writer->error < 0)
+        return writer->error;
+    uint8_t record[kRecordSize];
+    put_le64(record, (uint64_t)entry->pts);
+    put_le64(record + 8, (uint64_t)entry->dts);
+    put_le64(record + 16, (uint64_t)entry->offset);
+    put_le32(record + 24, entry->size);
+    record[28] = entry->pict_type;
+    record[29] = entry->key ? 1 : 0;
+    put_le16(record + 30, 0);
+    if (fwrite(record, 1, kRecordSize, writer->file) != kRecordSize)
+        writer->error = AVERROR(EIO);
+    return writer->error;
+}
+
+int packet_index_close(PacketIndexWriter** writer) {
+    PacketIndexWriter* w = *writer;
+    if (!w)
+        return 0;
+    int ret = w->error;
+    if (fclose(w->file) != 0 && ret >= 0)
+        ret = AVERROR(EIO);
+    delete w;
+    *writer = nullptr;
+    return ret;
+}
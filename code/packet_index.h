@@ -0,0 +1,53 @@
+#ifndef PACKET_INDEX_H
+#define PACKET_INDEX_H
+
+#include <cstdint>
+
+struct PacketIndexWriter;
+
+// Binary seek index written next to the output while it is muxed, so tools can
+// find keyframes and byte ranges without scanning the file. All fields are
+// little-endian.
+//
+// Header, 16 bytes:
+//   char    magic[4]     "VIDX"
+//   uint16  version      1
+//   uint16  record_size  32
+//   int32   time_base    numerator, then denominator, of pts/dts below
+// followed by one 32-byte record per output packet, in decode order:
+//   int64   pts
+//   int64   dts          strictly increasing, so records can be binary searched
+//   int64   offset       byte position in the output where the packet can be
+//                        read from, or -1 when unknown (see below)
+//   uint32  size         bytes
+//   uint8   pict_type    AVPictureType (1 = I, 2 = P, 3 = B), 0 if unknown
+//   uint8   flags        bit 0: keyframe
+//   uint16  reserved
+//
+// For a regular MP4 `offset` and `size` are the sample's exact location. For
+// fragmented MP4 `offset` is the start of the fragment holding the packet
+// (fragments open on keyframes, so a keyframe's offset is a valid range start).
+// Segmented outputs record -1, as their manifests already index the segments.
+
+static const int64_t kPacketIndexUnknownOffset = -1;
+
+struct PacketIndexEntry {
+    int64_t pts;
+    int64_t dts;
+    int64_t offset;
+    uint32_t size;
+    uint8_t pict_type;
+    bool key;
+};
+
+// Creates the index file. Returns nullptr on failure.
+PacketIndexWriter* packet_index_open(const char* path, int time_base_num, int time_base_den);
+
+// Appends one record. Returns 0 or a negative AVERROR code.
+int packet_index_add(PacketIndexWriter* writer, const PacketIndexEntry* entry);
+
+// Flushes and closes the file and frees `writer`. Returns 0 or a negative
+// AVERROR code.
+int packet_index_close(PacketIndexWriter** writer);
+
+#endif // PACKET_INDEX_H
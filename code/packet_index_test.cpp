@@ -0,0 +1,113 @@
+// Checks the on-disk layout of packet_index.h byte for byte: the 16-byte
+// header and the 32-byte little-endian records, including negative
+// timestamps and unknown offsets. Needs only the libavutil headers. Build
+// and run from the repository root:
+//
+//   g++ -std=c++17 -O2 code/packet_index_test.cpp code/packet_index.cpp -o packet_index_test
+//   ./packet_index_test
+//
+// Writes packet_index_test.vidx in the working directory and removes it.
+
+#include "packet_index.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const char* const kPath = "packet_index_test.vidx";
+
+static int failures = 0;
+
+static void append_le(std::vector<uint8_t>& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static std::vector<uint8_t> read_file(const char* path) {
+    std::vector<uint8_t> data;
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return data;
+    int c;
+    while ((c = fgetc(file)) != EOF)
+        data.push_back((uint8_t)c);
+    fclose(file);
+    return data;
+}
+
+int main() {
+    static const PacketIndexEntry entries[] = {
+        // A B-frame stream starting before zero, as edit lists leave it
+        {-2002, -3003, 48, 51234, 1, true},
+        {1001, -2002, 51282, 987, 3, false},
+        {0x123456789A, 0x1234567899, 0x7FFFFFFF00, 0xFFFFFFFFu, 2, false},
+        {5005, 4004, kPacketIndexUnknownOffset, 0, 0, true},
+    };
+
+    PacketIndexWriter* writer = packet_index_open(kPath, 1, 30000);
+    if (!writer) {
+        fprintf(stderr, "FAIL could not create %s\n", kPath);
+        return EXIT_FAILURE;
+    }
+    for (const PacketIndexEntry& entry : entries)
+        if (packet_index_add(writer, &entry) < 0)
+            failures++;
+    if (packet_index_close(&writer) < 0 || writer) {
+        fprintf(stderr, "FAIL packet_index_close\n");
+        failures++;
+    }
+
+    std::vector<uint8_t> expected = {'V', 'I', 'D', 'X'};
+    append_le(expected, 1, 2);     // version
+    append_le(expected, 32, 2);    // record_size
+    append_le(expected, 1, 4);     // time base numerator
+    append_le(expected, 30000, 4); // and denominator
+    if (expected.size() != 16) {
+        fprintf(stderr, "FAIL header is %zu bytes\n", expected.size());
+        failures++;
+    }
+    for (const PacketIndexEntry& entry : entries) {
+        size_t start = expected.size();
+        append_le(expected, (uint64_t)entry.pts, 8);
+        append_le(expected, (uint64_t)entry.dts, 8);
+        append_le(expected, (uint64_t)entry.offset, 8);
+        append_le(expected, entry.size, 4);
+        expected.push_back(entry.pict_type);
+        expected.push_back(entry.key ? 1 : 0);
+        append_le(expected, 0, 2); // reserved
+        if (expected.size() - start != 32) {
+            fprintf(stderr, "FAIL record is %zu bytes\n", expected.size() - start);
+            failures++;
+        }
+    }
+
+    std::vector<uint8_t> written = read_file(kPath);
+    remove(kPath);
+    if (written.size() != expected.size()) {
+        fprintf(stderr, "FAIL file is %zu bytes, expected %zu\n", written.size(), expected.size());
+        failures++;
+    } else {
+        for (size_t i = 0; i < written.size(); i++) {
+            if (written[i] != expected[i]) {
+                fprintf(stderr, "FAIL byte %zu is 0x%02x, expected 0x%02x\n", i, written[i], expected[i]);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    // Closing nothing is fine; a path that cannot be created is reported
+    if (packet_index_close(&writer) != 0) {
+        fprintf(stderr, "FAIL closing a null writer\n");
+        failures++;
+    }
+    writer = packet_index_open("packet_index_test_missing_dir/index.vidx", 1, 1);
+    if (writer) {
+        fprintf(stderr, "FAIL opened an index in a missing directory\n");
+        packet_index_close(&writer);
+        failures++;
+    }
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
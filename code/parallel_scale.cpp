@@ -0,0 +1,212 @@
+#include "parallel_scale.h"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include "pixfmt_convert.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Slice output (sws_receive_slice) arrived with libswscale 6 (FFmpeg 5.0);
+// older versions convert whole frames on the calling thread
+#if LIBSWSCALE_VERSION_MAJOR >= 6
+#define PARALLEL_SCALE_SLICES 1
+#endif
+
+// Bands shorter than this cost more in hand-off than they save
+static const int kMinBandRows = 64;
+static const unsigned kMaxAutoThreads = 16;
+
+struct Band {
+    int y_start;
+    int y_end;
+    SwsContext* sws_ctx; // nullptr when the dedicated kernel is used
+    int result;
+};
+
+struct ParallelScaler {
+    int src_width;
+    int src_height;
+    int src_format;
+    int dst_width;
+    int dst_height;
+    int dst_format;
+    PixfmtConvertFn kernel;
+    std::vector<Band> bands;
+
+    // Band 0 runs on the calling thread, band i on workers[i - 1]
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    uint64_t generation; // Bumped for every frame handed to the workers
+    int pending;         // Worker bands of the current frame still running
+    bool stopping;
+    const AVFrame* src;
+    AVFrame* dst;
+};
+
+static void run_band(ParallelScaler* s, Band* band) {
+    const AVFrame* src = s->src;
+    AVFrame* dst = s->dst;
+    if (s->kernel) {
+        s->kernel(src->data, src->linesize, dst->data, dst->linesize, s->dst_width, s->dst_height,
+                  band->y_start, band->y_end);
+        band->result = 0;
+        return;
+    }
+#if PARALLEL_SCALE_SLICES
+    int ret = sws_frame_start(band->sws_ctx, dst, src);
+    if (ret >= 0)
+        ret = sws_send_slice(band->sws_ctx, 0, s->src_height);
+    if (ret >= 0)
+        ret = sws_receive_slice(band->sws_ctx, band->y_start, band->y_end - band->y_start);
+    sws_frame_end(band->sws_ctx);
+    band->result = ret < 0 ? ret : 0;
+#else
+    sws_scale(band->sws_ctx, src->data, src->linesize, 0, s->src_height, dst->data, dst->linesize);
+    band->result = 0;
+#endif
+}
+
+static void worker_main(ParallelScaler* s, int index) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(s->mutex);
+            s->start.wait(lock, [s, seen] { return s->stopping || s->generation != seen; });
+            if (s->stopping)
+                return;
+            seen = s->generation;
+        }
+        run_band(s, &s->bands[index]);
+        {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            if (--s->pending == 0)
+                s->done.notify_one();
+        }
+    }
+}
+
+static SwsContext* create_sws(const ParallelScaler* s, int sws_flags) {
+    return sws_getContext(s->src_width, s->src_height, (enum AVPixelFormat)s->src_format, s->dst_width,
+                          s->dst_height, (enum AVPixelFormat)s->dst_format, sws_flags, nullptr, nullptr,
+                          nullptr);
+}
+
+ParallelScaler* parallel_scaler_create(int threads, int src_width, int src_height, int src_format,
+                                       int dst_width, int dst_height, int dst_format, int sws_flags) {
+    ParallelScaler* s = new ParallelScaler();
+    s->src_width = src_width;
+    s->src_height = src_height;
+    s->src_format = src_format;
+    s->dst_width = dst_width;
+    s->dst_height = dst_height;
+    s->dst_format = dst_format;
+    s->kernel = nullptr;
+    s->generation = 0;
+    s->pending = 0;
+    s->stopping = false;
+    s->src = nullptr;
+    s->dst = nullptr;
+
+    if (src_width == dst_width && src_height == dst_height && dst_format == AV_PIX_FMT_YUV420P)
+        s->kernel = pixfmt_find_converter(src_format);
+
+    // Band edges must sit on chroma rows (and whatever else swscale needs)
+    SwsContext* first = nullptr;
+    unsigned alignment = 2;
+    if (!s->kernel) {
+        first = create_sws(s, sws_flags);
+        if (!first) {
+            delete s;
+            return nullptr;
+        }
+#if PARALLEL_SCALE_SLICES
+        if (sws_receive_slice_alignment(first) > alignment)
+            alignment = sws_receive_slice_alignment(first);
+#else
+        threads = 1;
+#endif
+    }
+
+    if (threads <= 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        threads = cores == 0 ? 1 : cores > kMaxAutoThreads ? kMaxAutoThreads : (int)cores;
+    }
+    if (threads > dst_height / kMinBandRows)
+        threads = dst_height / kMinBandRows;
+    if (threads < 1)
+        threads = 1;
+    int rows = (dst_height + threads - 1) / threads;
+    rows = (int)((rows + alignment - 1) / alignment * alignment);
+
+    for (int y = 0; y < dst_height; y += rows) {
+        Band band;
+        band.y_start = y;
+        band.y_end = y + rows < dst_height ? y + rows : dst_height;
+        band.sws_ctx = nullptr;
+        band.result = 0;
+        if (!s->kernel) {
+            band.sws_ctx = s->bands.empty() ? first : create_sws(s, sws_flags);
+            if (!band.sws_ctx) {
+                parallel_scaler_free(&s);
+                return nullptr;
+            }
+        }
+        s->bands.push_back(band);
+    }
+    for (size_t i = 1; i < s->bands.size(); i++)
+        s->workers.emplace_back(worker_main, s, (int)i);
+    return s;
+}
+
+int parallel_scaler_scale(ParallelScaler* s, const AVFrame* src, AVFrame* dst) {
+    if (src->width != s->src_width || src->height != s->src_height || src->format != s->src_format) {
+        fprintf(stderr, "Frame does not match the scaler's input format\n");
+        return AVERROR(EINVAL);
+    }
+    s->src = src;
+    s->dst = dst;
+    if (!s->workers.empty()) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->pending = (int)s->workers.size();
+        s->generation++;
+    }
+    s->start.notify_all();
+    run_band(s, &s->bands[0]);
+    if (!s->workers.empty()) {
+        std::unique_lock<std::mutex> lock(s->mutex);
+        s->done.wait(lock, [s] { return s->pending == 0; });
+    }
+    s->src = nullptr;
+    s->dst = nullptr;
+    for (const Band& band : s->bands)
+        if (band.result < 0)
+            return band.result;
+    return 0;
+}
+
+void parallel_scaler_free(ParallelScaler** scaler) {
+    ParallelScaler* s = *scaler;
+    if (!s)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->stopping = true;
+    }
+    s->start.notify_all();
+    for (std::thread& worker : s->workers)
+        worker.join();
+    for (Band& band : s->bands)
+        sws_freeContext(band.sws_ctx);
+    delete s;
+    *scaler = nullptr;
+}
@@ -0,0 +1,28 @@
+#ifndef PARALLEL_SCALE_H
+#define PARALLEL_SCALE_H
+
+struct AVFrame;
+struct ParallelScaler;
+
+// Frame conversion split into horizontal bands of the output that a small pool
+// of threads converts concurrently. Each band has its own swscale context,
+// fed the whole source frame and asked for just its rows
+// (sws_receive_slice), so band edges are filtered exactly as in a single
+// pass. Same-size conversions with a dedicated kernel (pixfmt_convert.h) use
+// that kernel per band instead of swscale.
+
+// `threads` is the number of bands, 0 to pick one per core. Bands are never
+// made shorter than a few dozen rows, so small frames use fewer threads.
+// Returns nullptr on failure.
+ParallelScaler* parallel_scaler_create(int threads, int src_width, int src_height, int src_format,
+                                       int dst_width, int dst_height, int dst_format, int sws_flags);
+
+// Converts `src` into `dst`, which must be writable and match the sizes and
+// formats given at creation. Both must be reference counted. Returns 0 or a
+// negative AVERROR code.
+int parallel_scaler_scale(ParallelScaler* scaler, const AVFrame* src, AVFrame* dst);
+
+// Stops the worker threads and frees `scaler`.
+void parallel_scaler_free(ParallelScaler** scaler);
+
+#endif // PARALLEL_SCALE_H
@@ -0,0 +1,92 @@
+// Frame conversion time of parallel_scale.h by band count at 1080p, 4K and
+// 8K. Two conversions: 10-bit 4:2:2 to 8-bit 4:2:0 (swscale per band) and
+// NV12 to YUV420P (a pixfmt_convert.h kernel per band). Build (one command)
+// and run from the repository root:
+//
+//   g++ -std=c++17 -O2 -o parallel_scale_bench code/parallel_scale_bench.cpp code/parallel_scale.cpp
+//       code/pixfmt_convert.cpp -lswscale -lavutil -lpthread
+//   ./parallel_scale_bench
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "parallel_scale.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+static const int kIterations = 30;
+
+static AVFrame* alloc_frame(int width, int height, int format) {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame)
+        return nullptr;
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    // Mid grey in every plane; the content does not change the cost
+    for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->buf[p]; p++)
+        memset(frame->buf[p]->data, 0x40, frame->buf[p]->size);
+    return frame;
+}
+
+// Milliseconds per frame with `threads` bands, or -1 on failure
+static double time_conversion(int width, int height, int src_format, int threads) {
+    ParallelScaler* scaler = parallel_scaler_create(threads, width, height, src_format, width, height,
+                                                    AV_PIX_FMT_YUV420P, SWS_POINT);
+    AVFrame* src = alloc_frame(width, height, src_format);
+    AVFrame* dst = alloc_frame(width, height, AV_PIX_FMT_YUV420P);
+    double ms = -1;
+    if (scaler && src && dst && parallel_scaler_scale(scaler, src, dst) >= 0) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kIterations; i++)
+            parallel_scaler_scale(scaler, src, dst);
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+            kIterations;
+    }
+    parallel_scaler_free(&scaler);
+    av_frame_free(&src);
+    av_frame_free(&dst);
+    return ms;
+}
+
+int main() {
+    static const struct {
+        const char* name;
+        int width, height;
+    } sizes[] = {{"1080p", 1920, 1080}, {"4K", 3840, 2160}, {"8K", 7680, 4320}};
+    static const struct {
+        const char* name;
+        int format;
+    } formats[] = {{"yuv422p10 (swscale)", AV_PIX_FMT_YUV422P10LE}, {"nv12 (kernel)", AV_PIX_FMT_NV12}};
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+        cores = 1;
+
+    for (const auto& format : formats) {
+        printf("%s to yuv420p\n", format.name);
+        for (const auto& size : sizes) {
+            double single = 0;
+            for (unsigned threads = 1; threads <= cores; threads *= 2) {
+                double ms = time_conversion(size.width, size.height, format.format, (int)threads);
+                if (ms < 0) {
+                    fprintf(stderr, "Conversion failed\n");
+                    return 1;
+                }
+                if (threads == 1)
+                    single = ms;
+                printf("  %-6s %2u threads %8.3f ms/frame %5.2fx\n", size.name, threads, ms, single / ms);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,469 @@
+#include "pixfmt_convert.h"
+
+extern "C" {
+#include <libavutil/cpu.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define PIXFMT_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#endif
+#endif
+
+// Full (JPEG) to limited (MPEG) range in Q15: 219/255 for luma, 224/255 for
+// chroma. Matches _mm*_mulhrs_epi16 rounding in the scalar code.
+static const int kLumaRangeScale = 28142;
+static const int kChromaRangeScale = 28784;
+
+// Row operations every converter is built from; one table per instruction set
+struct RowKernels {
+    // src holds n interleaved pairs
+    void (*deinterleave)(const uint8_t* src, uint8_t* u, uint8_t* v, int n);
+    // Vertical average of two rows
+    void (*avg_rows)(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n);
+    // n outputs, each the average of a 2x2 block of rows a and b
+    void (*avg_2x2)(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n);
+    void (*range_luma)(const uint8_t* src, uint8_t* dst, int n);
+    void (*range_chroma)(const uint8_t* src, uint8_t* dst, int n);
+    // 10 bits in the low bits (yuv420p10) to 8
+    void (*shift10)(const uint16_t* src, uint8_t* dst, int n);
+    // 10 bits in the high bits (P010) to 8
+    void (*p010_luma)(const uint16_t* src, uint8_t* dst, int n);
+    void (*p010_chroma)(const uint16_t* src, uint8_t* u, uint8_t* v, int n);
+};
+
+static inline uint8_t clip_u8(int v) {
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+// ---------------------------------------------------------------------------
+// Scalar
+
+static void deinterleave_c(const uint8_t* src, uint8_t* u, uint8_t* v, int n) {
+    for (int i = 0; i < n; i++) {
+        u[i] = src[2 * i];
+        v[i] = src[2 * i + 1];
+    }
+}
+
+static void avg_rows_c(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = (uint8_t)((a[i] + b[i] + 1) >> 1);
+}
+
+static void avg_2x2_c(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = (uint8_t)((a[2 * i] + a[2 * i + 1] + b[2 * i] + b[2 * i + 1] + 2) >> 2);
+}
+
+static void range_luma_c(const uint8_t* src, uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = clip_u8(((src[i] * kLumaRangeScale + 16384) >> 15) + 16);
+}
+
+static void range_chroma_c(const uint8_t* src, uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = clip_u8((((src[i] - 128) * kChromaRangeScale + 16384) >> 15) + 128);
+}
+
+static void shift10_c(const uint16_t* src, uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = clip_u8((src[i] + 2) >> 2);
+}
+
+static inline uint8_t p010_to_u8(uint16_t v) {
+    return clip_u8((v + 128) >> 8);
+}
+
+static void p010_luma_c(const uint16_t* src, uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++)
+        dst[i] = p010_to_u8(src[i]);
+}
+
+static void p010_chroma_c(const uint16_t* src, uint8_t* u, uint8_t* v, int n) {
+    for (int i = 0; i < n; i++) {
+        u[i] = p010_to_u8(src[2 * i]);
+        v[i] = p010_to_u8(src[2 * i + 1]);
+    }
+}
+
+#if PIXFMT_X86
+// ---------------------------------------------------------------------------
+// AVX2, 32 output pixels per iteration. packus works within 128-bit lanes, so
+// results are put back in order with a cross-lane permute (0xD8 = 0, 2, 1, 3).
+
+TARGET_AVX2 static void deinterleave_avx2(const uint8_t* src, uint8_t* u, uint8_t* v, int n) {
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + 2 * i + 32));
+        __m256i uu = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i vv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i*)(u + i), _mm256_permute4x64_epi64(uu, 0xD8));
+        _mm256_storeu_si256((__m256i*)(v + i), _mm256_permute4x64_epi64(vv, 0xD8));
+    }
+    deinterleave_c(src + 2 * i, u + i, v + i, n - i);
+}
+
+TARGET_AVX2 static void avg_rows_avx2(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_avg_epu8(va, vb));
+    }
+    avg_rows_c(a + i, b + i, dst + i, n - i);
+}
+
+TARGET_AVX2 static void avg_2x2_avx2(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n) {
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        // maddubs adds horizontal byte pairs into 16-bit sums
+        __m256i s0 = _mm256_add_epi16(
+            _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(a + 2 * i)), ones),
+            _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(b + 2 * i)), ones));
+        __m256i s1 = _mm256_add_epi16(
+            _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(a + 2 * i + 32)), ones),
+            _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(b + 2 * i + 32)), ones));
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, two), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, two), 2);
+        _mm256_storeu_si256((__m256i*)(dst + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xD8));
+    }
+    avg_2x2_c(a + 2 * i, b + 2 * i, dst + i, n - i);
+}
+
+TARGET_AVX2 static void range_luma_avx2(const uint8_t* src, uint8_t* dst, int n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i scale = _mm256_set1_epi16(kLumaRangeScale);
+    const __m256i offset = _mm256_set1_epi16(16);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+        // unpack and packus are both in-lane, so the order survives
+        __m256i lo = _mm256_add_epi16(_mm256_mulhrs_epi16(_mm256_unpacklo_epi8(x, zero), scale), offset);
+        __m256i hi = _mm256_add_epi16(_mm256_mulhrs_epi16(_mm256_unpackhi_epi8(x, zero), scale), offset);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    range_luma_c(src + i, dst + i, n - i);
+}
+
+TARGET_AVX2 static void range_chroma_avx2(const uint8_t* src, uint8_t* dst, int n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i scale = _mm256_set1_epi16(kChromaRangeScale);
+    const __m256i bias = _mm256_set1_epi16(128);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(x, zero), bias);
+        __m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(x, zero), bias);
+        lo = _mm256_add_epi16(_mm256_mulhrs_epi16(lo, scale), bias);
+        hi = _mm256_add_epi16(_mm256_mulhrs_epi16(hi, scale), bias);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    range_chroma_c(src + i, dst + i, n - i);
+}
+
+// Rounds 16-bit samples down to 8 bits in place: (x + round) >> shift,
+// saturating, so out-of-range input clips like the scalar code
+TARGET_AVX2 static inline __m256i narrow_avx2(__m256i x, __m256i round, int shift) {
+    return _mm256_srl_epi16(_mm256_adds_epu16(x, round), _mm_cvtsi32_si128(shift));
+}
+
+TARGET_AVX2 static void shift_rows_avx2(const uint16_t* src, uint8_t* dst, int n, int round, int shift) {
+    const __m256i vround = _mm256_set1_epi16((short)round);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = narrow_avx2(_mm256_loadu_si256((const __m256i*)(src + i)), vround, shift);
+        __m256i b = narrow_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 16)), vround, shift);
+        _mm256_storeu_si256((__m256i*)(dst + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+    }
+    for (; i < n; i++)
+        dst[i] = clip_u8((src[i] + round) >> shift);
+}
+
+TARGET_AVX2 static void shift10_avx2(const uint16_t* src, uint8_t* dst, int n) {
+    shift_rows_avx2(src, dst, n, 2, 2);
+}
+
+TARGET_AVX2 static void p010_luma_avx2(const uint16_t* src, uint8_t* dst, int n) {
+    shift_rows_avx2(src, dst, n, 128, 8);
+}
+
+TARGET_AVX2 static void p010_chroma_avx2(const uint16_t* src, uint8_t* u, uint8_t* v, int n) {
+    const __m256i round = _mm256_set1_epi16(128);
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i c[4], uw[2], vw[2];
+        for (int k = 0; k < 4; k++)
+            c[k] = narrow_avx2(_mm256_loadu_si256((const __m256i*)(src + 2 * i + 16 * k)), round, 8);
+        // Even words are U, odd words V; narrow each to 16 pairs of words
+        for (int k = 0; k < 2; k++) {
+            __m256i u0 = _mm256_blend_epi16(c[2 * k], zero, 0xAA);
+            __m256i u1 = _mm256_blend_epi16(c[2 * k + 1], zero, 0xAA);
+            uw[k] = _mm256_permute4x64_epi64(_mm256_packus_epi32(u0, u1), 0xD8);
+            vw[k] = _mm256_permute4x64_epi64(
+                _mm256_packus_epi32(_mm256_srli_epi32(c[2 * k], 16), _mm256_srli_epi32(c[2 * k + 1], 16)),
+                0xD8);
+        }
+        _mm256_storeu_si256((__m256i*)(u + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(uw[0], uw[1]), 0xD8));
+        _mm256_storeu_si256((__m256i*)(v + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(vw[0], vw[1]), 0xD8));
+    }
+    p010_chroma_c(src + 2 * i, u + i, v + i, n - i);
+}
+
+// ---------------------------------------------------------------------------
+// AVX-512 (F + BW), 64 output pixels per iteration. The in-lane packs are
+// reordered with a 64-bit permute; P010 chroma stays on AVX2.
+
+TARGET_AVX512 static inline __m512i pack_order_avx512(__m512i packed) {
+    return _mm512_permutexvar_epi64(_mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7), packed);
+}
+
+TARGET_AVX512 static void deinterleave_avx512(const uint8_t* src, uint8_t* u, uint8_t* v, int n) {
+    const __m512i mask = _mm512_set1_epi16(0x00ff);
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i a = _mm512_loadu_si512((const void*)(src + 2 * i));
+        __m512i b = _mm512_loadu_si512((const void*)(src + 2 * i + 64));
+        __m512i uu = _mm512_packus_epi16(_mm512_and_si512(a, mask), _mm512_and_si512(b, mask));
+        __m512i vv = _mm512_packus_epi16(_mm512_srli_epi16(a, 8), _mm512_srli_epi16(b, 8));
+        _mm512_storeu_si512((void*)(u + i), pack_order_avx512(uu));
+        _mm512_storeu_si512((void*)(v + i), pack_order_avx512(vv));
+    }
+    deinterleave_avx2(src + 2 * i, u + i, v + i, n - i);
+}
+
+TARGET_AVX512 static void avg_rows_avx512(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n) {
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i va = _mm512_loadu_si512((const void*)(a + i));
+        __m512i vb = _mm512_loadu_si512((const void*)(b + i));
+        _mm512_storeu_si512((void*)(dst + i), _mm512_avg_epu8(va, vb));
+    }
+    avg_rows_avx2(a + i, b + i, dst + i, n - i);
+}
+
+TARGET_AVX512 static void avg_2x2_avx512(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n) {
+    const __m512i ones = _mm512_set1_epi8(1);
+    const __m512i two = _mm512_set1_epi16(2);
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i s0 = _mm512_add_epi16(
+            _mm512_maddubs_epi16(_mm512_loadu_si512((const void*)(a + 2 * i)), ones),
+            _mm512_maddubs_epi16(_mm512_loadu_si512((const void*)(b + 2 * i)), ones));
+        __m512i s1 = _mm512_add_epi16(
+            _mm512_maddubs_epi16(_mm512_loadu_si512((const void*)(a + 2 * i + 64)), ones),
+            _mm512_maddubs_epi16(_mm512_loadu_si512((const void*)(b + 2 * i + 64)), ones));
+        s0 = _mm512_srli_epi16(_mm512_add_epi16(s0, two), 2);
+        s1 = _mm512_srli_epi16(_mm512_add_epi16(s1, two), 2);
+        _mm512_storeu_si512((void*)(dst + i), pack_order_avx512(_mm512_packus_epi16(s0, s1)));
+    }
+    avg_2x2_avx2(a + 2 * i, b + 2 * i, dst + i, n - i);
+}
+
+TARGET_AVX512 static void range_luma_avx512(const uint8_t* src, uint8_t* dst, int n) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i scale = _mm512_set1_epi16(kLumaRangeScale);
+    const __m512i offset = _mm512_set1_epi16(16);
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void*)(src + i));
+        __m512i lo = _mm512_add_epi16(_mm512_mulhrs_epi16(_mm512_unpacklo_epi8(x, zero), scale), offset);
+        __m512i hi = _mm512_add_epi16(_mm512_mulhrs_epi16(_mm512_unpackhi_epi8(x, zero), scale), offset);
+        _mm512_storeu_si512((void*)(dst + i), _mm512_packus_epi16(lo, hi));
+    }
+    range_luma_avx2(src + i, dst + i, n - i);
+}
+
+TARGET_AVX512 static void range_chroma_avx512(const uint8_t* src, uint8_t* dst, int n) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i scale = _mm512_set1_epi16(kChromaRangeScale);
+    const __m512i bias = _mm512_set1_epi16(128);
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void*)(src + i));
+        __m512i lo = _mm512_sub_epi16(_mm512_unpacklo_epi8(x, zero), bias);
+        __m512i hi = _mm512_sub_epi16(_mm512_unpackhi_epi8(x, zero), bias);
+        lo = _mm512_add_epi16(_mm512_mulhrs_epi16(lo, scale), bias);
+        hi = _mm512_add_epi16(_mm512_mulhrs_epi16(hi, scale), bias);
+        _mm512_storeu_si512((void*)(dst + i), _mm512_packus_epi16(lo, hi));
+    }
+    range_chroma_avx2(src + i, dst + i, n - i);
+}
+
+TARGET_AVX512 static void shift_rows_avx512(const uint16_t* src, uint8_t* dst, int n, int round, int shift) {
+    const __m512i vround = _mm512_set1_epi16((short)round);
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512i a = _mm512_srl_epi16(_mm512_adds_epu16(_mm512_loadu_si512((const void*)(src + i)), vround), vshift);
+        __m512i b = _mm512_srl_epi16(_mm512_adds_epu16(_mm512_loadu_si512((const void*)(src + i + 32)), vround), vshift);
+        _mm512_storeu_si512((void*)(dst + i), pack_order_avx512(_mm512_packus_epi16(a, b)));
+    }
+    shift_rows_avx2(src + i, dst + i, n - i, round, shift);
+}
+
+TARGET_AVX512 static void shift10_avx512(const uint16_t* src, uint8_t* dst, int n) {
+    shift_rows_avx512(src, dst, n, 2, 2);
+}
+
+TARGET_AVX512 static void p010_luma_avx512(const uint16_t* src, uint8_t* dst, int n) {
+    shift_rows_avx512(src, dst, n, 128, 8);
+}
+#endif // PIXFMT_X86
+
+static RowKernels select_kernels() {
+    RowKernels k = {
+        deinterleave_c, avg_rows_c, avg_2x2_c, range_luma_c, range_chroma_c,
+        shift10_c, p010_luma_c, p010_chroma_c
+    };
+#if PIXFMT_X86
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2) {
+        k = RowKernels{
+            deinterleave_avx2, avg_rows_avx2, avg_2x2_avx2, range_luma_avx2, range_chroma_avx2,
+            shift10_avx2, p010_luma_avx2, p010_chroma_avx2
+        };
+    }
+    // libavutil only reports AVX512 when F, CD, BW, DQ and VL are all usable
+    if ((flags & AV_CPU_FLAG_AVX2) && (flags & AV_CPU_FLAG_AVX512)) {
+        k = RowKernels{
+            deinterleave_avx512, avg_rows_avx512, avg_2x2_avx512, range_luma_avx512,
+            range_chroma_avx512, shift10_avx512, p010_luma_avx512, p010_chroma_avx2
+        };
+    }
+#endif
+    return k;
+}
+
+static const RowKernels& kernels() {
+    static const RowKernels k = select_kernels();
+    return k;
+}
+
+// ---------------------------------------------------------------------------
+// Frame converters. Output chroma row c covers luma rows 2c and 2c + 1.
+
+static inline const uint8_t* row(const uint8_t* const plane[4], const int linesize[4], int p, int y) {
+    return plane[p] + (int64_t)y * linesize[p];
+}
+
+static inline uint8_t* row(uint8_t* const plane[4], const int linesize[4], int p, int y) {
+    return plane[p] + (int64_t)y * linesize[p];
+}
+
+static void copy_luma(const uint8_t* const src[4], const int src_linesize[4], uint8_t* const dst[4],
+                      const int dst_linesize[4], int width, int y_start, int y_end) {
+    for (int y = y_start; y < y_end; y++)
+        memcpy(row(dst, dst_linesize, 0, y), row(src, src_linesize, 0, y), width);
+}
+
+static void convert_nv12(const uint8_t* const src[4], const int src_linesize[4], uint8_t* const dst[4],
+                         const int dst_linesize[4], int width, int height, int y_start, int y_end) {
+    (void)height;
+    const RowKernels& k = kernels();
+    copy_luma(src, src_linesize, dst, dst_linesize, width, y_start, y_end);
+    for (int c = y_start / 2; c < (y_end + 1) / 2; c++)
+        k.deinterleave(row(src, src_linesize, 1, c), row(dst, dst_linesize, 1, c),
+                       row(dst, dst_linesize, 2, c), (width + 1) / 2);
+}
+
+static void convert_p010(const uint8_t* const src[4], const int src_linesize[4], uint8_t* const dst[4],
+                         const int dst_linesize[4], int width, int height, int y_start, int y_end) {
+    (void)height;
+    const RowKernels& k = kernels();
+    for (int y = y_start; y < y_end; y++)
+        k.p010_luma((const uint16_t*)row(src, src_linesize, 0, y), row(dst, dst_linesize, 0, y), width);
+    for (int c = y_start / 2; c < (y_end + 1) / 2; c++)
+        k.p010_chroma((const uint16_t*)row(src, src_linesize, 1, c), row(dst, dst_linesize, 1, c),
+                      row(dst, dst_linesize, 2, c), (width + 1) / 2);
+}
+
+static void convert_yuv420p10(const uint8_t* const src[4], const int src_linesize[4], uint8_t* const dst[4],
+                              const int dst_linesize[4], int width, int height, int y_start, int y_end) {
+    (void)height;
+    const RowKernels& k = kernels();
+    for (int y = y_start; y < y_end; y++)
+        k.shift10((const uint16_t*)row(src, src_linesize, 0, y), row(dst, dst_linesize, 0, y), width);
+    for (int c = y_start / 2; c < (y_end + 1) / 2; c++)
+        for (int p = 1; p <= 2; p++)
+            k.shift10((const uint16_t*)row(src, src_linesize, p, c), row(dst, dst_linesize, p, c),
+                      (width + 1) / 2);
+}
+
+static void convert_yuvj420p(const uint8_t* const src[4], const int src_linesize[4], uint8_t* const dst[4],
+                             const int dst_linesize[4], int width, int height, int y_start, int y_end) {
+    (void)height;
+    const RowKernels& k = kernels();
+    for (int y = y_start; y < y_end; y++)
+        k.range_luma(row(src, src_linesize, 0, y), row(dst, dst_linesize, 0, y), width);
+    for (int c = y_start / 2; c < (y_end + 1) / 2; c++)
+        for (int p = 1; p <= 2; p++)
+            k.range_chroma(row(src, src_linesize, p, c), row(dst, dst_linesize, p, c), (width + 1) / 2);
+}
+
+static void convert_yuv422p(const uint8_t* const src[4], const int src_linesize[4], uint8_t* const dst[4],
+                            const int dst_linesize[4], int width, int height, int y_start, int y_end) {
+    const RowKernels& k = kernels();
+    copy_luma(src, src_linesize, dst, dst_linesize, width, y_start, y_end);
+    for (int c = y_start / 2; c < (y_end + 1) / 2; c++) {
+        int y1 = 2 * c + 1 < height ? 2 * c + 1 : 2 * c;
+        for (int p = 1; p <= 2; p++)
+            k.avg_rows(row(src, src_linesize, p, 2 * c), row(src, src_linesize, p, y1),
+                       row(dst, dst_linesize, p, c), (width + 1) / 2);
+    }
+}
+
+static void convert_yuv444p(const uint8_t* const src[4], const int src_linesize[4], uint8_t* const dst[4],
+                            const int dst_linesize[4], int width, int height, int y_start, int y_end) {
+    const RowKernels& k = kernels();
+    copy_luma(src, src_linesize, dst, dst_linesize, width, y_start, y_end);
+    for (int c = y_start / 2; c < (y_end + 1) / 2; c++) {
+        int y1 = 2 * c + 1 < height ? 2 * c + 1 : 2 * c;
+        for (int p = 1; p <= 2; p++) {
+            const uint8_t* a = row(src, src_linesize, p, 2 * c);
+            const uint8_t* b = row(src, src_linesize, p, y1);
+            uint8_t* d = row(dst, dst_linesize, p, c);
+            k.avg_2x2(a, b, d, width / 2);
+            // An odd last column has no right-hand neighbour
+            if (width & 1)
+                d[width / 2] = (uint8_t)((a[width - 1] + b[width - 1] + 1) >> 1);
+        }
+    }
+}
+
+PixfmtConvertFn pixfmt_find_converter(int src_format) {
+    switch (src_format) {
+    case AV_PIX_FMT_NV12:
+        return convert_nv12;
+    case AV_PIX_FMT_P010LE:
+        return convert_p010;
+    case AV_PIX_FMT_YUV420P10LE:
+        return convert_yuv420p10;
+    case AV_PIX_FMT_YUVJ420P:
+        return convert_yuvj420p;
+    case AV_PIX_FMT_YUV422P:
+        return convert_yuv422p;
+    case AV_PIX_FMT_YUV444P:
+        return convert_yuv444p;
+    default:
+        return nullptr;
+    }
+}
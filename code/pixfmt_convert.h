@@ -0,0 +1,26 @@
+#ifndef PIXFMT_CONVERT_H
+#define PIXFMT_CONVERT_H
+
+#include <cstdint>
+
+// Dedicated same-size conversions to 8-bit YUV420P for the source formats we
+// see most, vectorized with AVX2 and AVX-512 and picked at run time from the
+// CPU flags libavutil reports. swscale's generic path runs every pixel
+// through its filter chain even when nothing is resized; these are plain row
+// operations (copy, deinterleave, average, shift).
+//
+// Supported sources: NV12, P010, YUV422P, YUV444P, YUVJ420P (full range is
+// mapped to limited range, as swscale does) and YUV420P10.
+
+// Converts luma rows [y_start, y_end) of a width x height frame, together
+// with the chroma rows they cover. y_start and y_end must be even unless
+// y_end == height, so slices can be converted concurrently.
+typedef void (*PixfmtConvertFn)(const uint8_t* const src[4], const int src_linesize[4],
+                                uint8_t* const dst[4], const int dst_linesize[4],
+                                int width, int height, int y_start, int y_end);
+
+// Returns the converter from `src_format` (an AVPixelFormat) to YUV420P at the
+// same size, or nullptr when there is no dedicated one.
+PixfmtConvertFn pixfmt_find_converter(int src_format);
+
+#endif // PIXFMT_CONVERT_H
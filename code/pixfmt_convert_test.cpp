@@ -0,0 +1,288 @@
+// Checks every vectorized kernel of pixfmt_convert.cpp against the scalar one,
+// and the dispatched frame converters against a scalar reference, on odd
+// widths and heights and on slices. Includes the implementation to reach its
+// static kernels. Build and run from the repository root:
+//
+//   g++ -std=c++17 -O2 code/pixfmt_convert_test.cpp -lavutil -o pixfmt_convert_test
+//   ./pixfmt_convert_test
+//
+// Exits non-zero on the first mismatch.
+
+#include "pixfmt_convert.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Written past the end of every output so overruns show up as mismatches
+static const uint8_t kGuard = 0xA5;
+static const int kGuardBytes = 64;
+
+static std::mt19937 rng(12345);
+
+static void fill_random(uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        p[i] = (uint8_t)rng();
+}
+
+struct NamedKernels {
+    const char* name;
+    RowKernels kernels;
+};
+
+static std::vector<NamedKernels> kernel_sets() {
+    std::vector<NamedKernels> sets;
+#if PIXFMT_X86
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2)
+        sets.push_back({"avx2", RowKernels{
+            deinterleave_avx2, avg_rows_avx2, avg_2x2_avx2, range_luma_avx2, range_chroma_avx2,
+            shift10_avx2, p010_luma_avx2, p010_chroma_avx2
+        }});
+    if ((flags & AV_CPU_FLAG_AVX2) && (flags & AV_CPU_FLAG_AVX512))
+        sets.push_back({"avx512", RowKernels{
+            deinterleave_avx512, avg_rows_avx512, avg_2x2_avx512, range_luma_avx512,
+            range_chroma_avx512, shift10_avx512, p010_luma_avx512, p010_chroma_avx2
+        }});
+#endif
+    return sets;
+}
+
+// Runs `call` on the scalar and the vector output buffers (with guard bytes
+// after `n` outputs each) and compares them
+template <typename Call>
+static bool compare_outputs(const char* set, const char* kernel, int n, int outputs, Call call) {
+    std::vector<uint8_t> ref(2 * (n + kGuardBytes), kGuard), out(2 * (n + kGuardBytes), kGuard);
+    uint8_t* ref_planes[2] = {ref.data(), ref.data() + n + kGuardBytes};
+    uint8_t* out_planes[2] = {out.data(), out.data() + n + kGuardBytes};
+    call(true, ref_planes[0], ref_planes[1]);
+    call(false, out_planes[0], out_planes[1]);
+    for (int p = 0; p < outputs; p++) {
+        for (int i = 0; i < n + kGuardBytes; i++) {
+            if (ref_planes[p][i] != out_planes[p][i]) {
+                fprintf(stderr, "FAIL %s %s n=%d plane %d: byte %d is %d, expected %d\n", set, kernel, n, p, i,
+                        out_planes[p][i], ref_planes[p][i]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool check_row_kernels(const NamedKernels& set) {
+    const RowKernels c = {
+        deinterleave_c, avg_rows_c, avg_2x2_c, range_luma_c, range_chroma_c,
+        shift10_c, p010_luma_c, p010_chroma_c
+    };
+    const RowKernels& k = set.kernels;
+    // Every remainder of the 32- and 64-wide loops, plus a few full blocks
+    for (int n = 0; n <= 200; n++) {
+        std::vector<uint8_t> a(2 * n + 1), b(2 * n + 1);
+        std::vector<uint16_t> w(2 * n + 1);
+        fill_random(a.data(), a.size());
+        fill_random(b.data(), b.size());
+        for (uint16_t& x : w)
+            x = (uint16_t)rng(); // Out-of-range values must clip the same way
+        const uint8_t* pa = a.data();
+        const uint8_t* pb = b.data();
+        const uint16_t* pw = w.data();
+        bool ok =
+            compare_outputs(set.name, "deinterleave", n, 2, [&](bool ref, uint8_t* u, uint8_t* v) {
+                (ref ? c : k).deinterleave(pa, u, v, n);
+            }) &&
+            compare_outputs(set.name, "avg_rows", n, 1, [&](bool ref, uint8_t* d, uint8_t*) {
+                (ref ? c : k).avg_rows(pa, pb, d, n);
+            }) &&
+            compare_outputs(set.name, "avg_2x2", n, 1, [&](bool ref, uint8_t* d, uint8_t*) {
+                (ref ? c : k).avg_2x2(pa, pb, d, n);
+            }) &&
+            compare_outputs(set.name, "range_luma", n, 1, [&](bool ref, uint8_t* d, uint8_t*) {
+                (ref ? c : k).range_luma(pa, d, n);
+            }) &&
+            compare_outputs(set.name, "range_chroma", n, 1, [&](bool ref, uint8_t* d, uint8_t*) {
+                (ref ? c : k).range_chroma(pa, d, n);
+            }) &&
+            compare_outputs(set.name, "shift10", n, 1, [&](bool ref, uint8_t* d, uint8_t*) {
+                (ref ? c : k).shift10(pw, d, n);
+            }) &&
+            compare_outputs(set.name, "p010_luma", n, 1, [&](bool ref, uint8_t* d, uint8_t*) {
+                (ref ? c : k).p010_luma(pw, d, n);
+            }) &&
+            compare_outputs(set.name, "p010_chroma", n, 2, [&](bool ref, uint8_t* u, uint8_t* v) {
+                (ref ? c : k).p010_chroma(pw, u, v, n);
+            });
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// A planar picture with padded rows, as decoders hand them out
+struct Picture {
+    std::vector<uint8_t> planes[3];
+    uint8_t* data[4];
+    int linesize[4];
+
+    Picture(const int widths[3], const int heights[3], bool random) {
+        for (int p = 0; p < 3; p++) {
+            linesize[p] = widths[p] + kGuardBytes;
+            planes[p].assign((size_t)linesize[p] * heights[p], kGuard);
+            if (random)
+                fill_random(planes[p].data(), planes[p].size());
+            data[p] = widths[p] ? planes[p].data() : nullptr;
+        }
+        data[3] = nullptr;
+        linesize[3] = 0;
+    }
+};
+
+// The same conversions written directly from the scalar row kernels
+static void reference_convert(int format, const Picture& src, Picture& dst, int width, int height) {
+    int cw = (width + 1) / 2;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* s = src.data[0] + (size_t)y * src.linesize[0];
+        uint8_t* d = dst.data[0] + (size_t)y * dst.linesize[0];
+        switch (format) {
+        case AV_PIX_FMT_P010LE:
+            p010_luma_c((const uint16_t*)s, d, width);
+            break;
+        case AV_PIX_FMT_YUV420P10LE:
+            shift10_c((const uint16_t*)s, d, width);
+            break;
+        case AV_PIX_FMT_YUVJ420P:
+            range_luma_c(s, d, width);
+            break;
+        default:
+            memcpy(d, s, width);
+        }
+    }
+    for (int c = 0; c < (height + 1) / 2; c++) {
+        uint8_t* u = dst.data[1] + (size_t)c * dst.linesize[1];
+        uint8_t* v = dst.data[2] + (size_t)c * dst.linesize[2];
+        int y1 = 2 * c + 1 < height ? 2 * c + 1 : 2 * c;
+        for (int i = 0; i < cw; i++) {
+            for (int p = 1; p <= 2; p++) {
+                uint8_t* out = p == 1 ? u : v;
+                // NV12 and P010 keep both chroma components in plane 1
+                int sp = src.data[p] ? p : 1;
+                const uint8_t* r0 = src.data[sp] + (size_t)2 * c * src.linesize[sp];
+                const uint8_t* r1 = src.data[sp] + (size_t)y1 * src.linesize[sp];
+                const uint8_t* rc = src.data[sp] + (size_t)c * src.linesize[sp];
+                switch (format) {
+                case AV_PIX_FMT_NV12:
+                    out[i] = rc[2 * i + p - 1];
+                    break;
+                case AV_PIX_FMT_P010LE:
+                    out[i] = p010_to_u8(((const uint16_t*)rc)[2 * i + p - 1]);
+                    break;
+                case AV_PIX_FMT_YUV420P10LE:
+                    out[i] = clip_u8((((const uint16_t*)rc)[i] + 2) >> 2);
+                    break;
+                case AV_PIX_FMT_YUVJ420P:
+                    range_chroma_c(rc + i, out + i, 1);
+                    break;
+                case AV_PIX_FMT_YUV422P:
+                    out[i] = (uint8_t)((r0[i] + r1[i] + 1) >> 1);
+                    break;
+                case AV_PIX_FMT_YUV444P:
+                    if (2 * i + 1 < width)
+                        out[i] = (uint8_t)((r0[2 * i] + r0[2 * i + 1] + r1[2 * i] + r1[2 * i + 1] + 2) >> 2);
+                    else
+                        out[i] = (uint8_t)((r0[2 * i] + r1[2 * i] + 1) >> 1);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Source plane sizes in bytes per row and rows
+static void source_layout(int format, int width, int height, int widths[3], int heights[3]) {
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    switch (format) {
+    case AV_PIX_FMT_NV12:
+        widths[0] = width, widths[1] = 2 * cw, widths[2] = 0;
+        heights[0] = height, heights[1] = ch, heights[2] = 0;
+        break;
+    case AV_PIX_FMT_P010LE:
+        widths[0] = 2 * width, widths[1] = 4 * cw, widths[2] = 0;
+        heights[0] = height, heights[1] = ch, heights[2] = 0;
+        break;
+    case AV_PIX_FMT_YUV420P10LE:
+        widths[0] = 2 * width, widths[1] = widths[2] = 2 * cw;
+        heights[0] = height, heights[1] = heights[2] = ch;
+        break;
+    case AV_PIX_FMT_YUV422P:
+        widths[0] = width, widths[1] = widths[2] = cw;
+        heights[0] = heights[1] = heights[2] = height;
+        break;
+    case AV_PIX_FMT_YUV444P:
+        widths[0] = widths[1] = widths[2] = width;
+        heights[0] = heights[1] = heights[2] = height;
+        break;
+    default: // YUVJ420P
+        widths[0] = width, widths[1] = widths[2] = cw;
+        heights[0] = height, heights[1] = heights[2] = ch;
+    }
+}
+
+static bool same_output(const Picture& a, const Picture& b, const char* what, int format, int width,
+                        int height) {
+    for (int p = 0; p < 3; p++) {
+        if (a.planes[p] != b.planes[p]) {
+            fprintf(stderr, "FAIL %s format %d %dx%d: plane %d differs\n", what, format, width, height, p);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool check_converters() {
+    static const int formats[] = {
+        AV_PIX_FMT_NV12, AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUVJ420P,
+        AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV444P
+    };
+    static const int sizes[][2] = {{1, 1}, {2, 2}, {3, 5}, {33, 7}, {63, 17}, {129, 31}, {130, 32}, {321, 45}};
+    for (int format : formats) {
+        PixfmtConvertFn convert = pixfmt_find_converter(format);
+        if (!convert) {
+            fprintf(stderr, "FAIL no converter for format %d\n", format);
+            return false;
+        }
+        for (const auto& size : sizes) {
+            int width = size[0], height = size[1];
+            int src_widths[3], src_heights[3];
+            source_layout(format, width, height, src_widths, src_heights);
+            int dst_widths[3] = {width, (width + 1) / 2, (width + 1) / 2};
+            int dst_heights[3] = {height, (height + 1) / 2, (height + 1) / 2};
+            Picture src(src_widths, src_heights, true);
+            Picture expected(dst_widths, dst_heights, false);
+            Picture whole(dst_widths, dst_heights, false);
+            Picture sliced(dst_widths, dst_heights, false);
+            reference_convert(format, src, expected, width, height);
+            convert(src.data, src.linesize, whole.data, whole.linesize, width, height, 0, height);
+            // Slices split on even rows, as parallel_scale hands them out
+            for (int y = 0; y < height; y += 6)
+                convert(src.data, src.linesize, sliced.data, sliced.linesize, width, height, y,
+                        y + 6 < height ? y + 6 : height);
+            if (!same_output(expected, whole, "frame", format, width, height) ||
+                !same_output(expected, sliced, "slices", format, width, height))
+                return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+    for (const NamedKernels& set : kernel_sets()) {
+        printf("Row kernels: %s\n", set.name);
+        ok = check_row_kernels(set) && ok;
+    }
+    printf("Frame converters\n");
+    ok = check_converters() && ok;
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,70 @@
+// Encode speed of proxy_mode against a normal conversion of the same input.
+// Both runs write to temporary files in the working directory, which
+// are removed afterwards. Build (one command) and run from the repository
+// root:
+//
+//   g++ -std=c++17 -O2 -o proxy_bench code/proxy_bench.cpp $(ls code/*.cpp | grep -v -e _test -e _bench)
+//       -lavformat -lavcodec -lavfilter -lswscale -lavutil -lpthread
+//   ./proxy_bench input.mp4 [threads]
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "video_converter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Video frames in `path`, counted from its packets
+static int64_t count_video_frames(const char* path) {
+    AVFormatContext* fmt_ctx = nullptr;
+    if (avformat_open_input(&fmt_ctx, path, nullptr, nullptr) < 0)
+        return -1;
+    int64_t frames = -1;
+    int stream_index = -1;
+    AVPacket* packet = av_packet_alloc();
+    if (packet && avformat_find_stream_info(fmt_ctx, nullptr) >= 0)
+        stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index >= 0) {
+        frames = 0;
+        while (av_read_frame(fmt_ctx, packet) >= 0) {
+            if (packet->stream_index == stream_index)
+                frames++;
+            av_packet_unref(packet);
+        }
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&fmt_ctx);
+    return frames;
+}
+
+static void run(const char* name, const char* input, const char* output, const VideoConverterOptions* options) {
+    auto start = std::chrono::steady_clock::now();
+    convert_video_to_h265_with_options(input, output, options);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int64_t frames = count_video_frames(output);
+    if (frames <= 0) {
+        fprintf(stderr, "%s: conversion produced no video\n", name);
+        return;
+    }
+    printf("%-7s %8lld frames %8.2f s %8.1f fps\n", name, (long long)frames, seconds, frames / seconds);
+    remove(output);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s input [threads]\n", argv[0]);
+        return 1;
+    }
+    VideoConverterOptions options;
+    video_converter_default_options(&options);
+    if (argc > 2)
+        options.thread_count = atoi(argv[2]);
+
+    run("normal", argv[1], "proxy_bench_normal.mp4", &options);
+    options.proxy_mode = 1;
+    run("proxy", argv[1], "proxy_bench_proxy.mp4", &options);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include "scale_policy.h"
+
+#include "video_converter.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+int scale_policy_flags(int src_width, int src_height, int dst_width, int dst_height, int quality) {
+    if (src_width == dst_width && src_height == dst_height)
+        return SWS_POINT;
+
+    switch (quality) {
+    case VIDEO_CONVERTER_SCALE_FAST:
+        return SWS_FAST_BILINEAR;
+    case VIDEO_CONVERTER_SCALE_BEST:
+        return SWS_LANCZOS | SWS_ACCURATE_RND;
+    default:
+        break;
+    }
+
+    // The stronger of the two axis ratios decides
+    double ratio_x = (double)dst_width / src_width;
+    double ratio_y = (double)dst_height / src_height;
+    double ratio = ratio_x < ratio_y ? ratio_x : ratio_y;
+    return ratio <= 0.5 ? SWS_BILINEAR : SWS_BICUBIC;
+}
@@ -0,0 +1,15 @@
+#ifndef SCALE_POLICY_H
+#define SCALE_POLICY_H
+
+// Picks swscale flags for a conversion from its scale ratio and a
+// speed/quality preference (a VideoConverterScaleQuality value):
+//   - same size, format change only: SWS_POINT, i.e. no resampling filter
+//     at all, just the format conversion
+//   - fast: SWS_FAST_BILINEAR for any resize
+//   - balanced: SWS_BILINEAR for downscales of 2x or more (swscale widens the
+//     filter with the ratio, so this already averages every source pixel),
+//     SWS_BICUBIC for milder downscales and for upscales
+//   - best: SWS_LANCZOS with accurate rounding
+int scale_policy_flags(int src_width, int src_height, int dst_width, int dst_height, int quality);
+
+#endif // SCALE_POLICY_H
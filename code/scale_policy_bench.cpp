@@ -0,0 +1,117 @@
+// Scaler microbenchmark suite for scale_policy.h: the time of every swscale
+// algorithm on typical conversions (format change only, 2x and 1.5x
+// downscales, an upscale), with the algorithm the policy picks for each
+// quality setting marked. Single-threaded sws_scale on whole frames. Build
+// (one command) and run from the repository root:
+//
+//   g++ -std=c++17 -O2 -o scale_policy_bench code/scale_policy_bench.cpp code/scale_policy.cpp
+//       -lswscale -lavutil
+//   ./scale_policy_bench
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "scale_policy.h"
+#include "video_converter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static const int kIterations = 20;
+
+static AVFrame* alloc_frame(int width, int height, int format) {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame)
+        return nullptr;
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    // A gradient, so the filters have something to work on
+    for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->buf[p]; p++)
+        for (size_t i = 0; i < frame->buf[p]->size; i++)
+            frame->buf[p]->data[i] = (uint8_t)(i * 31 / 7);
+    return frame;
+}
+
+// Milliseconds per frame, or -1 on failure
+static double time_scale(const AVFrame* src, AVFrame* dst, int flags) {
+    SwsContext* sws = sws_getContext(src->width, src->height, (enum AVPixelFormat)src->format, dst->width,
+                                     dst->height, (enum AVPixelFormat)dst->format, flags, nullptr, nullptr,
+                                     nullptr);
+    if (!sws)
+        return -1;
+    sws_scale(sws, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; i++)
+        sws_scale(sws, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+        kIterations;
+    sws_freeContext(sws);
+    return ms;
+}
+
+int main() {
+    static const struct {
+        const char* name;
+        int src_width, src_height, src_format;
+        int dst_width, dst_height;
+    } cases[] = {
+        {"1080p yuv422p to yuv420p", 1920, 1080, AV_PIX_FMT_YUV422P, 1920, 1080},
+        {"4K to 1080p", 3840, 2160, AV_PIX_FMT_YUV420P, 1920, 1080},
+        {"1080p to 720p", 1920, 1080, AV_PIX_FMT_YUV420P, 1280, 720},
+        {"720p to 1080p", 1280, 720, AV_PIX_FMT_YUV420P, 1920, 1080},
+    };
+    static const struct {
+        const char* name;
+        int flags;
+    } algorithms[] = {
+        {"point", SWS_POINT},
+        {"fast_bilinear", SWS_FAST_BILINEAR},
+        {"bilinear", SWS_BILINEAR},
+        {"bicubic", SWS_BICUBIC},
+        {"lanczos", SWS_LANCZOS | SWS_ACCURATE_RND},
+    };
+    static const struct {
+        const char* name;
+        int quality;
+    } qualities[] = {
+        {"fast", VIDEO_CONVERTER_SCALE_FAST},
+        {"balanced", VIDEO_CONVERTER_SCALE_BALANCED},
+        {"best", VIDEO_CONVERTER_SCALE_BEST},
+    };
+
+    for (const auto& c : cases) {
+        printf("%s\n", c.name);
+        AVFrame* src = alloc_frame(c.src_width, c.src_height, c.src_format);
+        AVFrame* dst = alloc_frame(c.dst_width, c.dst_height, AV_PIX_FMT_YUV420P);
+        if (!src || !dst) {
+            fprintf(stderr, "Could not allocate frames\n");
+            return 1;
+        }
+        for (const auto& algorithm : algorithms) {
+            std::string picked_by;
+            for (const auto& q : qualities) {
+                int flags = scale_policy_flags(c.src_width, c.src_height, c.dst_width, c.dst_height, q.quality);
+                if (flags == algorithm.flags)
+                    picked_by += std::string(picked_by.empty() ? " <- " : ", ") + q.name;
+            }
+            double ms = time_scale(src, dst, algorithm.flags);
+            if (ms < 0)
+                printf("  %-14s unsupported\n", algorithm.name);
+            else
+                printf("  %-14s %8.3f ms/frame%s\n", algorithm.name, ms, picked_by.c_str());
+        }
+        av_frame_free(&src);
+        av_frame_free(&dst);
+    }
+    return 0;
+}
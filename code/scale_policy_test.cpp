@@ -0,0 +1,59 @@
+// Checks the algorithm scale_policy.h picks for each kind of conversion and
+// quality setting. Needs only the swscale headers. Build and run from the
+// repository root:
+//
+//   g++ -std=c++17 -O2 code/scale_policy_test.cpp code/scale_policy.cpp -o scale_policy_test
+//   ./scale_policy_test
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+#include "scale_policy.h"
+#include "video_converter.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static int failures = 0;
+
+static void expect_flags(const char* what, int src_width, int src_height, int dst_width, int dst_height,
+                         int quality, int expected) {
+    int flags = scale_policy_flags(src_width, src_height, dst_width, dst_height, quality);
+    if (flags != expected) {
+        fprintf(stderr, "FAIL %s: %dx%d to %dx%d quality %d gave flags 0x%x, expected 0x%x\n", what, src_width,
+                src_height, dst_width, dst_height, quality, flags, expected);
+        failures++;
+    }
+}
+
+int main() {
+    static const int qualities[] = {
+        VIDEO_CONVERTER_SCALE_BALANCED, VIDEO_CONVERTER_SCALE_FAST, VIDEO_CONVERTER_SCALE_BEST
+    };
+    for (int quality : qualities) {
+        // A format change alone never resamples, whatever the preference
+        expect_flags("same size", 1920, 1080, 1920, 1080, quality, SWS_POINT);
+        expect_flags("same odd size", 721, 481, 721, 481, quality, SWS_POINT);
+    }
+
+    expect_flags("fast downscale", 3840, 2160, 1920, 1080, VIDEO_CONVERTER_SCALE_FAST, SWS_FAST_BILINEAR);
+    expect_flags("fast upscale", 1280, 720, 1920, 1080, VIDEO_CONVERTER_SCALE_FAST, SWS_FAST_BILINEAR);
+    expect_flags("best downscale", 3840, 2160, 1920, 1080, VIDEO_CONVERTER_SCALE_BEST,
+                 SWS_LANCZOS | SWS_ACCURATE_RND);
+    expect_flags("best upscale", 1280, 720, 1920, 1080, VIDEO_CONVERTER_SCALE_BEST,
+                 SWS_LANCZOS | SWS_ACCURATE_RND);
+
+    // Balanced: bilinear from a 2x downscale on, bicubic below that and for upscales
+    expect_flags("balanced 2x down", 3840, 2160, 1920, 1080, VIDEO_CONVERTER_SCALE_BALANCED, SWS_BILINEAR);
+    expect_flags("balanced 4x down", 3840, 2160, 960, 540, VIDEO_CONVERTER_SCALE_BALANCED, SWS_BILINEAR);
+    expect_flags("balanced 1.5x down", 1920, 1080, 1280, 720, VIDEO_CONVERTER_SCALE_BALANCED, SWS_BICUBIC);
+    expect_flags("balanced just under 2x", 1920, 1080, 961, 541, VIDEO_CONVERTER_SCALE_BALANCED, SWS_BICUBIC);
+    expect_flags("balanced upscale", 1280, 720, 1920, 1080, VIDEO_CONVERTER_SCALE_BALANCED, SWS_BICUBIC);
+    // The stronger axis decides: halving the width alone is a 2x downscale
+    expect_flags("balanced anamorphic", 1920, 1080, 960, 1080, VIDEO_CONVERTER_SCALE_BALANCED, SWS_BILINEAR);
+    expect_flags("balanced height only", 1920, 1080, 1920, 540, VIDEO_CONVERTER_SCALE_BALANCED, SWS_BILINEAR);
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
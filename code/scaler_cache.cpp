@@ -0,0 +1,249 @@
+#include "scaler_cache.h"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "parallel_scale.h"
+#include "scale_policy.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Display aspect ratios this close to the output's are stretched rather than
+// padded; a border of a pixel or two would only look like a glitch.
+static const double kAspectTolerance = 0.01;
+
+struct SourceGeometry {
+    int width;
+    int height;
+    int format;
+    AVRational sar; // 1:1 when the source does not say
+};
+
+struct CachedScaler {
+    SourceGeometry src;
+    // Where the picture lands in the output frame; the rest is black
+    int x, y, width, height;
+    ParallelScaler* scaler;
+    uint64_t last_used;
+};
+
+struct ScalerCache {
+    int capacity;
+    int threads;
+    int dst_width;
+    int dst_height;
+    AVRational dst_sar;
+    int dst_format;
+    int quality;
+    std::vector<CachedScaler> entries;
+    CachedScaler* current; // Entry of the last frame; almost every lookup hits it
+    SourceGeometry last;   // Geometry of the last frame converted, width 0 before the first
+    AVFrame* region;       // Reference to the part of the output frame the picture goes to
+    uint64_t clock;
+};
+
+static SourceGeometry make_geometry(int width, int height, int format, AVRational sar) {
+    SourceGeometry g;
+    g.width = width;
+    g.height = height;
+    g.format = format;
+    g.sar = sar.num > 0 && sar.den > 0 ? sar : AVRational{1, 1};
+    return g;
+}
+
+static bool same_geometry(const SourceGeometry& a, const SourceGeometry& b) {
+    return a.width == b.width && a.height == b.height && a.format == b.format &&
+        (int64_t)a.sar.num * b.sar.den == (int64_t)b.sar.num * a.sar.den;
+}
+
+// Fits the source's display aspect ratio into the output frame, centred.
+// Edges stay on chroma sample boundaries.
+static void fit_picture(const ScalerCache* cache, const SourceGeometry& src, CachedScaler* entry) {
+    entry->x = 0;
+    entry->y = 0;
+    entry->width = cache->dst_width;
+    entry->height = cache->dst_height;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)cache->dst_format);
+    if (!desc)
+        return;
+    int align_x = 1 << desc->log2_chroma_w;
+    int align_y = 1 << desc->log2_chroma_h;
+    double src_aspect = src.width * av_q2d(src.sar) / src.height;
+    double dst_aspect = cache->dst_width * av_q2d(cache->dst_sar) / cache->dst_height;
+    double ratio = src_aspect / dst_aspect;
+    if (ratio > 1 - kAspectTolerance && ratio < 1 + kAspectTolerance)
+        return;
+    if (ratio > 1) {
+        // Wider than the output: letterbox
+        int height = (int)(cache->dst_height / ratio) / align_y * align_y;
+        entry->height = height < align_y ? align_y : height;
+        entry->y = (cache->dst_height - entry->height) / 2 / align_y * align_y;
+    } else {
+        // Narrower: pillarbox
+        int width = (int)(cache->dst_width * ratio) / align_x * align_x;
+        entry->width = width < align_x ? align_x : width;
+        entry->x = (cache->dst_width - entry->width) / 2 / align_x * align_x;
+    }
+}
+
+// Points `data` at pixel (x, y) of every plane of `frame`, the way
+// av_frame_apply_cropping does. `x` and `y` must sit on chroma boundaries.
+static void plane_pointers(const AVFrame* frame, const AVPixFmtDescriptor* desc, int x, int y,
+                           uint8_t* data[4]) {
+    for (int i = 0; i < 4; i++)
+        data[i] = frame->data[i];
+    bool done[4] = {false, false, false, false};
+    for (int c = 0; c < desc->nb_components; c++) {
+        const AVComponentDescriptor* comp = &desc->comp[c];
+        if (done[comp->plane] || !frame->data[comp->plane])
+            continue;
+        bool chroma = (c == 1 || c == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int shift_x = chroma ? desc->log2_chroma_w : 0;
+        int shift_y = chroma ? desc->log2_chroma_h : 0;
+        data[comp->plane] += (y >> shift_y) * frame->linesize[comp->plane] + (x >> shift_x) * comp->step;
+        done[comp->plane] = true;
+    }
+}
+
+static void fill_black(const AVFrame* frame, const AVPixFmtDescriptor* desc, int x, int y, int width,
+                       int height) {
+    if (width <= 0 || height <= 0)
+        return;
+    uint8_t* data[4];
+    ptrdiff_t linesize[4];
+    plane_pointers(frame, desc, x, y, data);
+    for (int i = 0; i < 4; i++)
+        linesize[i] = frame->linesize[i];
+    av_image_fill_black(data, linesize, (enum AVPixelFormat)frame->format, frame->color_range, width, height);
+}
+
+static CachedScaler* find_scaler(ScalerCache* cache, const SourceGeometry& src) {
+    CachedScaler* current = cache->current;
+    if (current && same_geometry(current->src, src))
+        return current;
+
+    for (CachedScaler& entry : cache->entries) {
+        if (same_geometry(entry.src, src)) {
+            cache->current = &entry;
+            return &entry;
+        }
+    }
+
+    CachedScaler fitted;
+    fit_picture(cache, src, &fitted);
+    ParallelScaler* scaler = parallel_scaler_create(
+        cache->threads, src.width, src.height, src.format, fitted.width, fitted.height, cache->dst_format,
+        scale_policy_flags(src.width, src.height, fitted.width, fitted.height, cache->quality));
+    if (!scaler)
+        return nullptr;
+
+    CachedScaler* entry;
+    if ((int)cache->entries.size() < cache->capacity) {
+        cache->entries.push_back(CachedScaler());
+        entry = &cache->entries.back();
+    } else {
+        entry = &cache->entries[0];
+        for (CachedScaler& candidate : cache->entries)
+            if (candidate.last_used < entry->last_used)
+                entry = &candidate;
+        parallel_scaler_free(&entry->scaler);
+    }
+    entry->src = src;
+    entry->x = fitted.x;
+    entry->y = fitted.y;
+    entry->width = fitted.width;
+    entry->height = fitted.height;
+    entry->scaler = scaler;
+    entry->last_used = 0;
+    cache->current = entry;
+    return entry;
+}
+
+ScalerCache* scaler_cache_create(int capacity, int threads, int dst_width, int dst_height, AVRational dst_sar,
+                                 int dst_format, int quality) {
+    if (capacity < 1 || dst_width <= 0 || dst_height <= 0)
+        return nullptr;
+    ScalerCache* cache = new ScalerCache();
+    cache->region = av_frame_alloc();
+    if (!cache->region) {
+        delete cache;
+        return nullptr;
+    }
+    cache->capacity = capacity;
+    cache->threads = threads;
+    cache->dst_width = dst_width;
+    cache->dst_height = dst_height;
+    cache->dst_sar = dst_sar.num > 0 && dst_sar.den > 0 ? dst_sar : AVRational{1, 1};
+    cache->dst_format = dst_format;
+    cache->quality = quality;
+    // Entries are handed out by pointer; never let the vector move them
+    cache->entries.reserve(capacity);
+    cache->current = nullptr;
+    cache->last = SourceGeometry();
+    cache->clock = 0;
+    return cache;
+}
+
+int scaler_cache_prepare(ScalerCache* cache, int src_width, int src_height, int src_format,
+                         AVRational src_sar) {
+    SourceGeometry src = make_geometry(src_width, src_height, src_format, src_sar);
+    return find_scaler(cache, src) ? 0 : AVERROR(EINVAL);
+}
+
+int scaler_cache_scale(ScalerCache* cache, const AVFrame* src, AVFrame* dst) {
+    SourceGeometry geometry = make_geometry(src->width, src->height, src->format, src->sample_aspect_ratio);
+    CachedScaler* entry = find_scaler(cache, geometry);
+    if (!entry) {
+        fprintf(stderr, "Cannot convert %dx%d frames (pixel format %d)\n", src->width, src->height,
+                src->format);
+        return AVERROR(EINVAL);
+    }
+    // Compared with the last frame rather than the cache entry, so a scaler
+    // rebuilt after eviction does not look like a change of input
+    if (cache->last.width && !same_geometry(cache->last, geometry))
+        fprintf(stderr, "Input changed to %dx%d, aspect %d:%d (pixel format %d)\n", src->width, src->height,
+                geometry.sar.num, geometry.sar.den, src->format);
+    cache->last = geometry;
+    entry->last_used = ++cache->clock;
+
+    if (entry->width == cache->dst_width && entry->height == cache->dst_height)
+        return parallel_scaler_scale(entry->scaler, src, dst);
+
+    // Scale into the fitted part of the frame and blank the borders around
+    // it, which may still hold a picture of the previous geometry
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)dst->format);
+    int ret = av_frame_ref(cache->region, dst);
+    if (ret < 0)
+        return ret;
+    plane_pointers(dst, desc, entry->x, entry->y, cache->region->data);
+    cache->region->width = entry->width;
+    cache->region->height = entry->height;
+    ret = parallel_scaler_scale(entry->scaler, src, cache->region);
+    av_frame_unref(cache->region);
+    if (ret < 0)
+        return ret;
+    int right = entry->x + entry->width;
+    int bottom = entry->y + entry->height;
+    fill_black(dst, desc, 0, 0, dst->width, entry->y);
+    fill_black(dst, desc, 0, bottom, dst->width, dst->height - bottom);
+    fill_black(dst, desc, 0, entry->y, entry->x, entry->height);
+    fill_black(dst, desc, right, entry->y, dst->width - right, entry->height);
+    return 0;
+}
+
+void scaler_cache_free(ScalerCache** cache) {
+    ScalerCache* c = *cache;
+    if (!c)
+        return;
+    for (CachedScaler& entry : c->entries)
+        parallel_scaler_free(&entry.scaler);
+    av_frame_free(&c->region);
+    delete c;
+    *cache = nullptr;
+}
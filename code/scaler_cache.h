@@ -0,0 +1,35 @@
+#ifndef SCALER_CACHE_H
+#define SCALER_CACHE_H
+
+struct AVFrame;
+struct AVRational;
+struct ScalerCache;
+
+// Conversions into one fixed output size and format from whatever the decoder
+// hands out. Streams that change resolution or pixel format mid-file (screen
+// recordings, broadcast captures switching feeds) get a parallel scaler
+// (parallel_scale.h) per source geometry, kept in a small least recently used
+// cache so switching back and forth does not rebuild them on every change.
+// A source whose display aspect ratio differs from the output's is
+// letterboxed or pillarboxed into it rather than stretched.
+
+// `dst_sar` is the output's sample aspect ratio (0/1 for square pixels).
+// `threads` and `quality` (a VideoConverterScaleQuality value) apply to every
+// scaler created; `capacity` is the number of geometries kept at once.
+// Returns nullptr on failure.
+ScalerCache* scaler_cache_create(int capacity, int threads, int dst_width, int dst_height, AVRational dst_sar,
+                                 int dst_format, int quality);
+
+// Makes sure a scaler for the given source geometry exists, so setup errors
+// surface before decoding starts. Returns 0 or a negative AVERROR code.
+int scaler_cache_prepare(ScalerCache* cache, int src_width, int src_height, int src_format, AVRational src_sar);
+
+// Converts `src` into `dst` (writable, of the output size and format) with the
+// scaler matching `src`, creating it if needed. Padding is filled with black
+// in `dst->color_range`. Returns 0 or a negative AVERROR code.
+int scaler_cache_scale(ScalerCache* cache, const AVFrame* src, AVFrame* dst);
+
+// Frees every cached scaler and `cache`.
+void scaler_cache_free(ScalerCache** cache);
+
+#endif // SCALER_CACHE_H
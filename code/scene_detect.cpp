@@ -0,0 +1,72 @@
+#include "scene_detect.h"
+
+#include "luma_reduce.h"
+
+#include <cmath>
+#include <vector>
+
+struct SceneDetector {
+    double threshold;
+    int min_scene_frames;
+    int width;                 // Size of the reduced plane
+    int height;
+    std::vector<uint8_t> prev;
+    std::vector<uint8_t> cur;
+    bool have_prev;
+    double prev_mafd;
+    int64_t frames_since_cut;
+};
+
+SceneDetector* scene_detector_create(double threshold, int min_scene_frames) {
+    SceneDetector* detector = new SceneDetector();
+    detector->threshold = threshold;
+    detector->min_scene_frames = min_scene_frames;
+    detector->width = 0;
+    detector->height = 0;
+    detector->have_prev = false;
+    detector->prev_mafd = 0;
+    detector->frames_since_cut = 0;
+    return detector;
+}
+
+bool scene_detector_is_cut(SceneDetector* detector, const uint8_t* luma, int linesize, int width,
+                           int height, int bit_depth) {
+    int out_w = width / kLumaBlockSize;
+    int out_h = height / kLumaBlockSize;
+    if (out_w <= 0 || out_h <= 0)
+        return false;
+    // A resolution change starts over; it is not itself a scene change
+    if (out_w != detector->width || out_h != detector->height) {
+        detector->width = out_w;
+        detector->height = out_h;
+        detector->prev.assign((size_t)out_w * out_h, 0);
+        detector->cur.assign((size_t)out_w * out_h, 0);
+        detector->have_prev = false;
+    }
+    luma_reduce_blocks(luma, linesize, width, height, bit_depth, detector->cur.data());
+    detector->prev.swap(detector->cur);
+    detector->frames_since_cut++;
+    if (!detector->have_prev) {
+        detector->have_prev = true;
+        detector->prev_mafd = 0;
+        return false;
+    }
+
+    // prev now holds this frame, cur the previous one
+    size_t n = detector->prev.size();
+    double mafd = (double)luma_sum_abs_diff(detector->prev.data(), detector->cur.data(), n) / n;
+    double diff = fabs(mafd - detector->prev_mafd);
+    detector->prev_mafd = mafd;
+    double score = fmin(mafd, diff) / 100.0;
+    if (score > 1.0)
+        score = 1.0;
+    if (score < detector->threshold || detector->frames_since_cut < detector->min_scene_frames)
+        return false;
+    detector->frames_since_cut = 0;
+    return true;
+}
+
+void scene_detector_free(SceneDetector** detector) {
+    delete *detector;
+    *detector = nullptr;
+}
@@ -0,0 +1,28 @@
+#ifndef SCENE_DETECT_H
+#define SCENE_DETECT_H
+
+#include <cstdint>
+
+struct SceneDetector;
+
+// Cheap shot-change detection on the luma plane of the frames about to be
+// encoded. Each frame is reduced to 8x8 block averages (luma_reduce.h) and
+// compared with the previous one.
+// The score follows FFmpeg's scene filter: the mean absolute frame difference,
+// minus the previous frame's, on a 0-1 scale, so steady motion or a fade does
+// not count as a cut.
+
+// `threshold` is the score (0-1) from which a frame starts a new scene;
+// `min_scene_frames` suppresses cuts closer than that to the previous one
+// (flashes, strobes).
+SceneDetector* scene_detector_create(double threshold, int min_scene_frames);
+
+// Returns true when the luma plane starts a new scene. The first frame never
+// does. `bit_depth` above 8 means 16-bit little-endian samples of that depth
+// (up to 15 bits).
+bool scene_detector_is_cut(SceneDetector* detector, const uint8_t* luma, int linesize, int width,
+                           int height, int bit_depth);
+
+void scene_detector_free(SceneDetector** detector);
+
+#endif // SCENE_DETECT_H
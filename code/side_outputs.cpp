@@ -0,0 +1,331 @@
+#include "side_outputs.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/version.h>
+#include <libswscale/swscale.h>
+}
+
+#include "sprite_sheet.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Decoded frames waiting for the side outputs. Small, because each one pins a
+// full-resolution decoder buffer.
+static const size_t kQueueDepth = 8;
+
+static const int kThumbnailColumns = 10;
+static const int kThumbnailRows = 10;
+static const int kThumbnailQuality = 5;
+
+struct SideOutputs {
+    SideOutputConfig config;
+    AVRational time_base;
+    AVRational frame_rate;
+
+    // Thumbnails
+    SpriteSheetWriter* sprites;
+    int64_t next_thumbnail_us;
+    int64_t end_us;              // End of the last frame seen, closes the last cue
+
+    // Preview
+    AVFormatContext* preview_fmt_ctx;
+    AVCodecContext* preview_enc;
+    SwsContext* preview_sws;
+    AVFrame* preview_frame;
+    AVPacket* preview_packet;
+    bool preview_failed;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable dequeued;
+    std::deque<AVFrame*> queue;
+    bool closing;
+    int error;
+};
+
+static void record_error(SideOutputs* so, int err, const char* what) {
+    fprintf(stderr, "%s, skipping it for the rest of the input\n", what);
+    std::lock_guard<std::mutex> lock(so->mutex);
+    if (so->error >= 0)
+        so->error = err;
+}
+
+// Browsers play H.264 everywhere; fall back to HEVC when libavcodec was built
+// without an H.264 encoder
+static const AVCodec* find_preview_encoder() {
+    const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
+    return encoder ? encoder : avcodec_find_encoder(AV_CODEC_ID_HEVC);
+}
+
+static int open_preview(SideOutputs* so, const AVFrame* frame) {
+    const char* path = so->config.preview_file;
+    const AVCodec* encoder = find_preview_encoder();
+    if (!encoder)
+        return AVERROR(EINVAL);
+    int ret = avformat_alloc_output_context2(&so->preview_fmt_ctx, nullptr, "mp4", path);
+    if (ret < 0)
+        return ret;
+    AVStream* stream = avformat_new_stream(so->preview_fmt_ctx, nullptr);
+    so->preview_enc = avcodec_alloc_context3(encoder);
+    so->preview_frame = av_frame_alloc();
+    so->preview_packet = av_packet_alloc();
+    if (!stream || !so->preview_enc || !so->preview_frame || !so->preview_packet)
+        return AVERROR(ENOMEM);
+
+    // Keep the display aspect ratio with square pixels and even dimensions
+    AVRational sar = frame->sample_aspect_ratio;
+    if (sar.num <= 0 || sar.den <= 0)
+        sar = AVRational{1, 1};
+    int width = so->config.preview_width < frame->width ? so->config.preview_width : frame->width;
+    int64_t height = av_rescale((int64_t)width * frame->height, sar.den, (int64_t)frame->width * sar.num);
+    AVCodecContext* enc = so->preview_enc;
+    enc->width = width & ~1;
+    enc->height = (int)((height + 1) & ~1);
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->time_base = so->time_base;
+    enc->framerate = so->frame_rate;
+    enc->bit_rate = so->config.preview_bit_rate;
+    enc->thread_count = so->config.thread_count;
+    if (so->preview_fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    av_opt_set(enc->priv_data, "preset", "veryfast", 0);
+    ret = avcodec_open2(enc, encoder, nullptr);
+    if (ret < 0)
+        return ret;
+    ret = avcodec_parameters_from_context(stream->codecpar, enc);
+    if (ret < 0)
+        return ret;
+    stream->time_base = enc->time_base;
+
+    // Fast bilinear is plenty for a preview this small
+    so->preview_sws = sws_getCachedContext(nullptr, frame->width, frame->height,
+                                           (enum AVPixelFormat)frame->format, enc->width, enc->height,
+                                           enc->pix_fmt, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+    if (!so->preview_sws)
+        return AVERROR(EINVAL);
+    so->preview_frame->format = enc->pix_fmt;
+    so->preview_frame->width = enc->width;
+    so->preview_frame->height = enc->height;
+    ret = av_frame_get_buffer(so->preview_frame, 0);
+    if (ret < 0)
+        return ret;
+
+    ret = avio_open(&so->preview_fmt_ctx->pb, path, AVIO_FLAG_WRITE);
+    if (ret < 0)
+        return ret;
+    return avformat_write_header(so->preview_fmt_ctx, nullptr);
+}
+
+static int write_preview_packets(SideOutputs* so) {
+    AVStream* stream = so->preview_fmt_ctx->streams[0];
+    for (;;) {
+        int ret = avcodec_receive_packet(so->preview_enc, so->preview_packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        else if (ret < 0)
+            return ret;
+        av_packet_rescale_ts(so->preview_packet, so->preview_enc->time_base, stream->time_base);
+        so->preview_packet->stream_index = stream->index;
+        ret = av_interleaved_write_frame(so->preview_fmt_ctx, so->preview_packet);
+        av_packet_unref(so->preview_packet);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+static int encode_preview(SideOutputs* so, const AVFrame* frame) {
+    int ret;
+    if (!so->preview_enc && (ret = open_preview(so, frame)) < 0)
+        return ret;
+    // The frame may still be referenced by the encoder from the last call
+    ret = av_frame_make_writable(so->preview_frame);
+    if (ret < 0)
+        return ret;
+    so->preview_sws = sws_getCachedContext(so->preview_sws, frame->width, frame->height,
+                                           (enum AVPixelFormat)frame->format,
+                                           so->preview_frame->width, so->preview_frame->height,
+                                           so->preview_enc->pix_fmt, SWS_FAST_BILINEAR,
+                                           nullptr, nullptr, nullptr);
+    if (!so->preview_sws)
+        return AVERROR(EINVAL);
+    sws_scale(so->preview_sws, frame->data, frame->linesize, 0, frame->height,
+              so->preview_frame->data, so->preview_frame->linesize);
+    so->preview_frame->pts = frame->pts;
+    ret = avcodec_send_frame(so->preview_enc, so->preview_frame);
+    if (ret < 0)
+        return ret;
+    return write_preview_packets(so);
+}
+
+// AVFrame.duration replaced pkt_duration in libavutil 57.30, and the key frame
+// flag replaced key_frame in 58.7
+static int64_t frame_duration(const AVFrame* frame) {
+#if LIBAVUTIL_VERSION_MAJOR > 57 || (LIBAVUTIL_VERSION_MAJOR == 57 && LIBAVUTIL_VERSION_MINOR >= 30)
+    return frame->duration;
+#else
+    return frame->pkt_duration;
+#endif
+}
+
+static bool frame_is_key(const AVFrame* frame) {
+#if LIBAVUTIL_VERSION_MAJOR > 58 || (LIBAVUTIL_VERSION_MAJOR == 58 && LIBAVUTIL_VERSION_MINOR >= 7)
+    return (frame->flags & AV_FRAME_FLAG_KEY) != 0;
+#else
+    return frame->key_frame != 0;
+#endif
+}
+
+static void process_frame(SideOutputs* so, AVFrame* frame) {
+    int64_t time_us = frame->pts == AV_NOPTS_VALUE ? so->end_us :
+        av_rescale_q(frame->pts, so->time_base, AV_TIME_BASE_Q);
+    int64_t duration = frame_duration(frame);
+    int64_t duration_us = duration > 0 ? av_rescale_q(duration, so->time_base, AV_TIME_BASE_Q) :
+        av_rescale_q(1, av_inv_q(so->frame_rate), AV_TIME_BASE_Q);
+    if (time_us + duration_us > so->end_us)
+        so->end_us = time_us + duration_us;
+
+    if (so->sprites) {
+        bool take = so->config.thumbnail_interval > 0 ? time_us >= so->next_thumbnail_us :
+            frame_is_key(frame);
+        if (take) {
+            int ret = sprite_sheet_add(so->sprites, frame, time_us);
+            if (ret < 0) {
+                record_error(so, ret, "Thumbnail generation failed");
+                sprite_sheet_close(&so->sprites, so->end_us);
+            }
+            so->next_thumbnail_us = time_us + so->config.thumbnail_interval;
+        }
+    }
+
+    if (so->config.preview_file && !so->preview_failed) {
+        int ret = encode_preview(so, frame);
+        if (ret < 0) {
+            record_error(so, ret, "Preview encoding failed");
+            so->preview_failed = true;
+        }
+    }
+}
+
+static void worker_main(SideOutputs* so) {
+    for (;;) {
+        AVFrame* frame;
+        {
+            std::unique_lock<std::mutex> lock(so->mutex);
+            so->queued.wait(lock, [so] { return !so->queue.empty() || so->closing; });
+            if (so->queue.empty())
+                return;
+            frame = so->queue.front();
+            so->queue.pop_front();
+        }
+        so->dequeued.notify_one();
+        process_frame(so, frame);
+        av_frame_free(&frame);
+    }
+}
+
+static int finish_preview(SideOutputs* so) {
+    int ret = 0;
+    if (so->preview_enc && !so->preview_failed) {
+        ret = avcodec_send_frame(so->preview_enc, nullptr);
+        if (ret >= 0)
+            ret = write_preview_packets(so);
+        if (ret >= 0)
+            ret = av_write_trailer(so->preview_fmt_ctx);
+        if (ret < 0)
+            fprintf(stderr, "Error while finishing the preview\n");
+    }
+    if (so->preview_fmt_ctx) {
+        avio_closep(&so->preview_fmt_ctx->pb);
+        avformat_free_context(so->preview_fmt_ctx);
+    }
+    sws_freeContext(so->preview_sws);
+    av_packet_free(&so->preview_packet);
+    av_frame_free(&so->preview_frame);
+    avcodec_free_context(&so->preview_enc);
+    return ret;
+}
+
+SideOutputs* side_outputs_open(const SideOutputConfig* config, AVRational time_base,
+                               AVRational frame_rate) {
+    if (!config->thumbnail_prefix && !config->preview_file)
+        return nullptr;
+    SideOutputs* so = new SideOutputs();
+    so->config = *config;
+    so->time_base = time_base;
+    so->frame_rate = frame_rate;
+    so->sprites = nullptr;
+    so->next_thumbnail_us = INT64_MIN;
+    so->end_us = 0;
+    so->preview_fmt_ctx = nullptr;
+    so->preview_enc = nullptr;
+    so->preview_sws = nullptr;
+    so->preview_frame = nullptr;
+    so->preview_packet = nullptr;
+    so->preview_failed = false;
+    so->closing = false;
+    so->error = 0;
+    if (config->thumbnail_prefix) {
+        so->sprites = sprite_sheet_open(config->thumbnail_prefix, config->thumbnail_width,
+                                        kThumbnailColumns, kThumbnailRows, kThumbnailQuality);
+        if (!so->sprites) {
+            // The preview does not depend on the thumbnails, so keep it going
+            // and let side_outputs_close report the failure
+            fprintf(stderr, "Could not start thumbnail generation for '%s'\n", config->thumbnail_prefix);
+            so->error = AVERROR(EIO);
+            if (!config->preview_file) {
+                delete so;
+                return nullptr;
+            }
+        }
+    }
+    so->worker = std::thread(worker_main, so);
+    return so;
+}
+
+void side_outputs_push(SideOutputs* so, const AVFrame* frame, int64_t pts) {
+    AVFrame* ref = av_frame_clone(frame);
+    if (!ref) {
+        record_error(so, AVERROR(ENOMEM), "Side output queueing failed");
+        return;
+    }
+    ref->pts = pts;
+    {
+        std::unique_lock<std::mutex> lock(so->mutex);
+        so->dequeued.wait(lock, [so] { return so->queue.size() < kQueueDepth; });
+        so->queue.push_back(ref);
+    }
+    so->queued.notify_one();
+}
+
+int side_outputs_close(SideOutputs** outputs) {
+    SideOutputs* so = *outputs;
+    if (!so)
+        return 0;
+    {
+        std::lock_guard<std::mutex> lock(so->mutex);
+        so->closing = true;
+    }
+    so->queued.notify_one();
+    so->worker.join();
+
+    int ret = so->error;
+    if (so->sprites) {
+        int err = sprite_sheet_close(&so->sprites, so->end_us);
+        if (ret >= 0)
+            ret = err;
+    }
+    int err = finish_preview(so);
+    if (ret >= 0)
+        ret = err;
+    delete so;
+    *outputs = nullptr;
+    return ret;
+}
@@ -0,0 +1,40 @@
+#ifndef SIDE_OUTPUTS_H
+#define SIDE_OUTPUTS_H
+
+#include <cstdint>
+
+struct AVFrame;
+struct AVRational;
+struct SideOutputs;
+
+// Derivatives of an upload produced from the main transcode's decoded frames,
+// so one decode serves all of them: scrubbing thumbnails (see sprite_sheet.h)
+// and a small low-bitrate preview MP4. The work runs on its own thread behind
+// a short frame queue, alongside the main encoder.
+
+struct SideOutputConfig {
+    const char* thumbnail_prefix; // nullptr for no thumbnails
+    int thumbnail_width;
+    int64_t thumbnail_interval;   // Microseconds between thumbnails, 0 for every keyframe
+    const char* preview_file;     // nullptr for no preview
+    int preview_width;
+    int64_t preview_bit_rate;
+    int thread_count;             // Preview encoder threads
+};
+
+// Returns nullptr when neither output is requested or on failure. Frames are
+// timed in `time_base`; `frame_rate` is the nominal rate given to the preview
+// encoder.
+SideOutputs* side_outputs_open(const SideOutputConfig* config, AVRational time_base,
+                               AVRational frame_rate);
+
+// Queues a reference to `frame`, timed at `pts` (relative to the start of the
+// output). Blocks only while the queue is full. A failing side output is
+// reported once and then skipped; the main transcode carries on.
+void side_outputs_push(SideOutputs* outputs, const AVFrame* frame, int64_t pts);
+
+// Processes the queued frames, finishes both outputs and frees `outputs`.
+// Returns 0 or the first negative AVERROR code a side output hit.
+int side_outputs_close(SideOutputs** outputs);
+
+#endif // SIDE_OUTPUTS_H
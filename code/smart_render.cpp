@@ -0,0 +1,613 @@
+#include "smart_render.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+// HEVC NAL unit types touched when splicing
+static const int kHevcNalCra = 21;
+static const int kHevcNalBlaNoLeading = 18; // BLA_N_LP
+
+// Boundary GOPs are short; spend bits so they hold up next to the untouched source
+static const char* kBoundaryCrf = "20";
+
+struct IndexEntry {
+    int64_t pts;
+    int64_t dts;
+    bool key;
+};
+
+struct HevcConfig {
+    int nal_length_size;
+    std::vector<std::vector<uint8_t>> parameter_sets; // VPS/SPS/PPS/SEI from hvcC
+};
+
+// Which packets (by position in decode order from the first keyframe read) go where
+struct RenderPlan {
+    int k1;          // First keyframe at or after the start: copying begins here
+    int head_last;   // Last of K1's leading pictures; the head decoder stops here
+    int kend;        // Keyframe where copying stops, or -1 to copy to the end
+    int tail_start;  // Keyframe of the last copied GOP; the tail decoder starts here
+    bool head;       // Frames between the start and K1 need re-encoding
+    int64_t max_copied_pts;
+};
+
+// One re-encoded piece at a cut point
+struct BoundarySegment {
+    AVCodecContext* dec;
+    AVCodecContext* enc;
+    int64_t min_pts;   // Frames with min_pts <= pts < max_pts are re-encoded
+    int64_t max_pts;   // AV_NOPTS_VALUE for no upper bound
+    int64_t dts_shift; // Subtracted from output dts to stay below the first copied packet
+    bool reached_end;  // A frame at or past max_pts came out of the decoder
+};
+
+struct SmartRender {
+    AVStream* in_stream;
+    HevcConfig config;
+    AVFormatContext* out_fmt_ctx;
+    AVStream* out_stream;
+    int64_t pts_offset;           // Subtracted from every timestamp so the output starts at zero
+    int thread_count;
+    bool head_written;            // Copied packets can go straight to the muxer
+    std::deque<AVPacket*> held;   // Copied packets read before the head was finished
+};
+
+static bool parse_hvcc(const uint8_t* data, int size, HevcConfig* config) {
+    // Annex B extradata (raw .hevc, MPEG-TS) has no hvcC to take parameter sets from
+    if (!data || size < 23 || data[0] != 1)
+        return false;
+    config->nal_length_size = (data[21] & 3) + 1;
+    if (config->nal_length_size == 3)
+        return false;
+    int num_arrays = data[22];
+    int pos = 23;
+    for (int i = 0; i < num_arrays; i++) {
+        if (pos + 3 > size)
+            return false;
+        int count = (data[pos + 1] << 8) | data[pos + 2];
+        pos += 3;
+        for (int j = 0; j < count; j++) {
+            if (pos + 2 > size)
+                return false;
+            int len = (data[pos] << 8) | data[pos + 1];
+            pos += 2;
+            if (pos + len > size)
+                return false;
+            config->parameter_sets.emplace_back(data + pos, data + pos + len);
+            pos += len;
+        }
+    }
+    return true;
+}
+
+static void write_nal_length(uint8_t* dst, uint32_t len, int nal_length_size) {
+    for (int i = nal_length_size - 1; i >= 0; i--) {
+        dst[i] = len & 0xff;
+        len >>= 8;
+    }
+}
+
+// Rewrites the Annex B access unit the encoder produced as length-prefixed NAL
+// units, which is what the copied packets and the hvcC sample entry use
+static int annexb_to_length_prefixed(const AVPacket* in, int nal_length_size, AVPacket* out) {
+    std::vector<std::pair<int, int>> nals; // offset, length
+    const uint8_t* data = in->data;
+    int start = -1;
+    int i = 0;
+    while (i + 2 < in->size) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (start >= 0)
+                nals.push_back({start, i - start});
+            i += 3;
+            start = i;
+        } else {
+            i++;
+        }
+    }
+    if (start >= 0)
+        nals.push_back({start, in->size - start});
+
+    int total = 0;
+    for (auto& nal : nals) {
+        // Drop the leading zero of a following 4-byte start code
+        while (nal.second > 0 && data[nal.first + nal.second - 1] == 0)
+            nal.second--;
+        total += nal_length_size + nal.second;
+    }
+    int ret = av_new_packet(out, total);
+    if (ret < 0)
+        return ret;
+    uint8_t* dst = out->data;
+    for (const auto& nal : nals) {
+        write_nal_length(dst, nal.second, nal_length_size);
+        memcpy(dst + nal_length_size, data + nal.first, nal.second);
+        dst += nal_length_size + nal.second;
+    }
+    av_packet_copy_props(out, in);
+    return 0;
+}
+
+// The first copied keyframe starts a new coded video sequence after the
+// re-encoded head: give it the source's parameter sets in-band and turn a CRA
+// into a BLA without leading pictures (they were dropped from the copy)
+static int make_splice_packet(const AVPacket* in, const HevcConfig& config, AVPacket* out) {
+    int prefix = 0;
+    for (const auto& ps : config.parameter_sets)
+        prefix += config.nal_length_size + (int)ps.size();
+    int ret = av_new_packet(out, prefix + in->size);
+    if (ret < 0)
+        return ret;
+    uint8_t* dst = out->data;
+    for (const auto& ps : config.parameter_sets) {
+        write_nal_length(dst, (uint32_t)ps.size(), config.nal_length_size);
+        memcpy(dst + config.nal_length_size, ps.data(), ps.size());
+        dst += config.nal_length_size + ps.size();
+    }
+    memcpy(dst, in->data, in->size);
+
+    uint8_t* end = dst + in->size;
+    while (dst + config.nal_length_size < end) {
+        uint32_t len = 0;
+        for (int i = 0; i < config.nal_length_size; i++)
+            len = (len << 8) | dst[i];
+        uint8_t* nal = dst + config.nal_length_size;
+        if (len == 0 || nal + len > end)
+            break;
+        if (((nal[0] >> 1) & 0x3f) == kHevcNalCra)
+            nal[0] = (uint8_t)((nal[0] & 0x81) | (kHevcNalBlaNoLeading << 1));
+        dst = nal + len;
+    }
+    av_packet_copy_props(out, in);
+    return 0;
+}
+
+static int seek_to_start(AVFormatContext* in_fmt_ctx, int stream_index, int64_t start_pts) {
+    return avformat_seek_file(in_fmt_ctx, stream_index, INT64_MIN, start_pts, start_pts, 0);
+}
+
+// Reads packet timestamps, without decoding, from the keyframe at or before the
+// start until the first keyframe past the end of the range (or past K1 when
+// there is no end)
+static int build_index(AVFormatContext* in_fmt_ctx, int stream_index, int64_t start_pts,
+                       int64_t end_pts, std::vector<IndexEntry>* index, bool* hit_eof) {
+    int ret = seek_to_start(in_fmt_ctx, stream_index, start_pts);
+    if (ret < 0)
+        return ret;
+    AVPacket* pkt = av_packet_alloc();
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    int64_t k1_pts = AV_NOPTS_VALUE;
+    while ((ret = av_read_frame(in_fmt_ctx, pkt)) >= 0) {
+        if (pkt->stream_index != stream_index) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (pkt->pts == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt);
+            ret = AVERROR(ENOSYS);
+            break;
+        }
+        bool key = pkt->flags & AV_PKT_FLAG_KEY;
+        index->push_back({pkt->pts, pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts, key});
+        int64_t pts = pkt->pts;
+        av_packet_unref(pkt);
+        if (!key)
+            continue;
+        if (end_pts != AV_NOPTS_VALUE ? pts > end_pts : k1_pts != AV_NOPTS_VALUE && pts > k1_pts)
+            break;
+        if (k1_pts == AV_NOPTS_VALUE && pts >= start_pts)
+            k1_pts = pts;
+    }
+    av_packet_free(&pkt);
+    *hit_eof = ret == AVERROR_EOF;
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+static bool make_plan(const std::vector<IndexEntry>& index, bool hit_eof, int64_t start_pts,
+                      int64_t end_pts, RenderPlan* plan) {
+    if (index.empty() || !index[0].key)
+        return false;
+    int n = (int)index.size();
+
+    plan->k1 = -1;
+    for (int i = 0; i < n && plan->k1 < 0; i++)
+        if (index[i].key && index[i].pts >= start_pts)
+            plan->k1 = i;
+    if (plan->k1 < 0)
+        return false;
+    const IndexEntry& k1 = index[plan->k1];
+    plan->head = start_pts < k1.pts;
+    plan->head_last = plan->k1;
+    while (plan->head_last + 1 < n && index[plan->head_last + 1].pts < k1.pts)
+        plan->head_last++;
+
+    // Copy to the end of the input when the range runs past it
+    plan->kend = -1;
+    bool past_end = false;
+    for (const IndexEntry& entry : index)
+        past_end |= end_pts != AV_NOPTS_VALUE && entry.pts >= end_pts;
+    if (end_pts != AV_NOPTS_VALUE && (past_end || !hit_eof)) {
+        for (int i = plan->k1 + 1; i < n; i++)
+            if (index[i].key && index[i].pts <= end_pts)
+                plan->kend = i;
+        // The whole range sits inside one GOP: nothing to copy
+        if (plan->kend < 0)
+            return false;
+    }
+
+    plan->max_copied_pts = k1.pts;
+    plan->tail_start = plan->k1;
+    if (plan->kend >= 0) {
+        for (int i = plan->k1; i < plan->kend; i++) {
+            if (i > plan->k1 && i <= plan->head_last)
+                continue;
+            if (index[i].pts > plan->max_copied_pts)
+                plan->max_copied_pts = index[i].pts;
+            if (index[i].key)
+                plan->tail_start = i;
+        }
+    }
+    return true;
+}
+
+static bool encoder_supports(const AVCodec* encoder, int pix_fmt) {
+    if (!encoder->pix_fmts)
+        return true;
+    for (const enum AVPixelFormat* p = encoder->pix_fmts; *p != AV_PIX_FMT_NONE; p++)
+        if (*p == pix_fmt)
+            return true;
+    return false;
+}
+
+static AVCodecContext* open_decoder(AVStream* in_stream, int thread_count) {
+    const AVCodec* decoder = avcodec_find_decoder(in_stream->codecpar->codec_id);
+    if (!decoder)
+        return nullptr;
+    AVCodecContext* dec = avcodec_alloc_context3(decoder);
+    if (!dec)
+        return nullptr;
+    dec->pkt_timebase = in_stream->time_base;
+    dec->thread_count = thread_count;
+    if (avcodec_parameters_to_context(dec, in_stream->codecpar) < 0 ||
+        avcodec_open2(dec, decoder, nullptr) < 0)
+        avcodec_free_context(&dec);
+    return dec;
+}
+
+// Opened on the first frame to re-encode so it matches the decoded format
+static AVCodecContext* open_boundary_encoder(const AVFrame* frame, AVStream* in_stream,
+                                             int thread_count) {
+    const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_HEVC);
+    if (!encoder)
+        return nullptr;
+    AVCodecContext* enc = avcodec_alloc_context3(encoder);
+    if (!enc)
+        return nullptr;
+    enc->width = frame->width;
+    enc->height = frame->height;
+    enc->pix_fmt = (enum AVPixelFormat)frame->format;
+    enc->sample_aspect_ratio = frame->sample_aspect_ratio;
+    enc->color_range = frame->color_range;
+    enc->color_primaries = frame->color_primaries;
+    enc->color_trc = frame->color_trc;
+    enc->colorspace = frame->colorspace;
+    // Timestamps stay in the input stream's time base end to end
+    enc->time_base = in_stream->time_base;
+    enc->framerate = av_guess_frame_rate(nullptr, in_stream, nullptr);
+    if (enc->framerate.num <= 0 || enc->framerate.den <= 0)
+        enc->framerate = AVRational{25, 1};
+    // No B-frames: dts == pts keeps the splice with the copied packets monotonic
+    enc->max_b_frames = 0;
+    av_opt_set(enc->priv_data, "preset", "medium", 0);
+    av_opt_set(enc->priv_data, "crf", kBoundaryCrf, 0);
+    av_opt_set_int(enc->priv_data, "threads", thread_count, 0);
+    // Without a global header libx265 repeats VPS/SPS/PPS in-band, which the
+    // 'hev1' output relies on
+    if (avcodec_open2(enc, encoder, nullptr) < 0)
+        avcodec_free_context(&enc);
+    return enc;
+}
+
+// Takes ownership of `pkt`, whose timestamps are absolute in the input time base
+static int write_output_packet(SmartRender* sr, AVPacket* pkt) {
+    pkt->pts -= sr->pts_offset;
+    pkt->dts -= sr->pts_offset;
+    pkt->stream_index = sr->out_stream->index;
+    pkt->pos = -1;
+    av_packet_rescale_ts(pkt, sr->in_stream->time_base, sr->out_stream->time_base);
+    int ret = av_interleaved_write_frame(sr->out_fmt_ctx, pkt);
+    av_packet_free(&pkt);
+    if (ret < 0)
+        fprintf(stderr, "Error while writing output packet\n");
+    return ret;
+}
+
+static int copy_packet(SmartRender* sr, const AVPacket* in, bool splice_point) {
+    AVPacket* pkt = av_packet_alloc();
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    int ret = splice_point ? make_splice_packet(in, sr->config, pkt) : av_packet_ref(pkt, in);
+    if (ret < 0) {
+        av_packet_free(&pkt);
+        return ret;
+    }
+    if (!sr->head_written) {
+        sr->held.push_back(pkt);
+        return 0;
+    }
+    return write_output_packet(sr, pkt);
+}
+
+static int drain_encoder(SmartRender* sr, BoundarySegment* seg) {
+    AVPacket* encoded = av_packet_alloc();
+    if (!encoded)
+        return AVERROR(ENOMEM);
+    int ret;
+    for (;;) {
+        ret = avcodec_receive_packet(seg->enc, encoded);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error during encoding\n");
+            break;
+        }
+        AVPacket* pkt = av_packet_alloc();
+        ret = pkt ? annexb_to_length_prefixed(encoded, sr->config.nal_length_size, pkt) : AVERROR(ENOMEM);
+        av_packet_unref(encoded);
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            break;
+        }
+        pkt->dts -= seg->dts_shift;
+        ret = write_output_packet(sr, pkt);
+        if (ret < 0)
+            break;
+    }
+    av_packet_free(&encoded);
+    return ret;
+}
+
+// Feeds `pkt` (nullptr flushes) to the segment's decoder and re-encodes the
+// frames that fall inside it
+static int decode_segment(SmartRender* sr, BoundarySegment* seg, const AVPacket* pkt, AVFrame* frame) {
+    int ret = avcodec_send_packet(seg->dec, pkt);
+    if (ret < 0) {
+        fprintf(stderr, "Error sending packet for decoding\n");
+        return ret;
+    }
+    for (;;) {
+        ret = avcodec_receive_frame(seg->dec, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        else if (ret < 0) {
+            fprintf(stderr, "Error during decoding\n");
+            return ret;
+        }
+        int64_t pts = frame->pts;
+        if (seg->max_pts != AV_NOPTS_VALUE && pts >= seg->max_pts)
+            seg->reached_end = true;
+        if (pts < seg->min_pts || seg->reached_end) {
+            av_frame_unref(frame);
+            continue;
+        }
+        if (!seg->enc) {
+            seg->enc = open_boundary_encoder(frame, sr->in_stream, sr->thread_count);
+            if (!seg->enc) {
+                fprintf(stderr, "Cannot open video encoder for stream\n");
+                av_frame_unref(frame);
+                return AVERROR(EINVAL);
+            }
+        }
+        // The decoder's picture type would otherwise be taken as a forced keyframe
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        ret = avcodec_send_frame(seg->enc, frame);
+        av_frame_unref(frame);
+        if (ret < 0) {
+            fprintf(stderr, "Error sending frame for encoding\n");
+            return ret;
+        }
+        ret = drain_encoder(sr, seg);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+static int finish_segment(SmartRender* sr, BoundarySegment* seg, AVFrame* frame) {
+    int ret = decode_segment(sr, seg, nullptr, frame);
+    if (ret >= 0 && seg->enc) {
+        ret = avcodec_send_frame(seg->enc, nullptr);
+        if (ret >= 0)
+            ret = drain_encoder(sr, seg);
+    }
+    avcodec_free_context(&seg->enc);
+    avcodec_free_context(&seg->dec);
+    return ret;
+}
+
+static int flush_held_packets(SmartRender* sr) {
+    sr->head_written = true;
+    int ret = 0;
+    while (!sr->held.empty()) {
+        AVPacket* pkt = sr->held.front();
+        sr->held.pop_front();
+        if (ret < 0)
+            av_packet_free(&pkt);
+        else
+            ret = write_output_packet(sr, pkt);
+    }
+    return ret;
+}
+
+static int render(AVFormatContext* in_fmt_ctx, int stream_index, const std::vector<IndexEntry>& index,
+                  const RenderPlan& plan, int64_t start_pts, int64_t end_pts, SmartRender* sr) {
+    BoundarySegment head = {};
+    BoundarySegment tail = {};
+    AVPacket* pkt = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    int ret = pkt && frame ? seek_to_start(in_fmt_ctx, stream_index, start_pts) : AVERROR(ENOMEM);
+    if (ret < 0)
+        goto end;
+
+    if (plan.head) {
+        head.dec = open_decoder(sr->in_stream, sr->thread_count);
+        head.min_pts = start_pts;
+        head.max_pts = index[plan.k1].pts;
+        head.dts_shift = index[plan.k1].pts - index[plan.k1].dts;
+        if (!head.dec) {
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+    }
+    sr->head_written = !plan.head;
+    if (plan.kend >= 0) {
+        tail.dec = open_decoder(sr->in_stream, sr->thread_count);
+        tail.min_pts = plan.max_copied_pts + 1;
+        tail.max_pts = end_pts;
+        if (!tail.dec) {
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+    }
+
+    for (int i = 0; !tail.reached_end; ) {
+        ret = av_read_frame(in_fmt_ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            break;
+        }
+        if (pkt->stream_index != stream_index) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        // The second pass has to see exactly the packets the index was built from
+        if (i < (int)index.size() && pkt->pts != index[i].pts) {
+            fprintf(stderr, "Input changed between smart render passes\n");
+            ret = AVERROR(EIO);
+            break;
+        }
+
+        if (head.dec && i <= plan.head_last) {
+            ret = decode_segment(sr, &head, pkt, frame);
+            if (ret >= 0 && i == plan.head_last) {
+                ret = finish_segment(sr, &head, frame);
+                if (ret >= 0)
+                    ret = flush_held_packets(sr);
+            }
+        }
+        bool leading = i > plan.k1 && i <= plan.head_last;
+        if (ret >= 0 && i >= plan.k1 && !leading && (plan.kend < 0 || i < plan.kend))
+            ret = copy_packet(sr, pkt, i == plan.k1);
+        if (ret >= 0 && tail.dec && i >= plan.tail_start)
+            ret = decode_segment(sr, &tail, pkt, frame);
+        av_packet_unref(pkt);
+        if (ret < 0)
+            break;
+        i++;
+    }
+
+    if (ret >= 0 && head.dec)
+        ret = finish_segment(sr, &head, frame);
+    if (ret >= 0 && !sr->head_written)
+        ret = flush_held_packets(sr);
+    if (ret >= 0 && tail.dec)
+        ret = finish_segment(sr, &tail, frame);
+
+end:
+    avcodec_free_context(&head.enc);
+    avcodec_free_context(&head.dec);
+    avcodec_free_context(&tail.enc);
+    avcodec_free_context(&tail.dec);
+    for (AVPacket* held : sr->held)
+        av_packet_free(&held);
+    sr->held.clear();
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+int smart_render_hevc(AVFormatContext* in_fmt_ctx, int video_stream_index, const char* output_url,
+                      int64_t start_time, int64_t end_time, int thread_count, bool faststart) {
+    AVStream* in_stream = in_fmt_ctx->streams[video_stream_index];
+    SmartRender sr;
+    sr.in_stream = in_stream;
+    sr.out_fmt_ctx = nullptr;
+    sr.thread_count = thread_count;
+    sr.head_written = false;
+
+    // Both passes seek, and the splice needs the source's parameter sets and a
+    // format the encoder can reproduce
+    const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_HEVC);
+    if ((in_fmt_ctx->pb && !in_fmt_ctx->pb->seekable) || !encoder ||
+        !encoder_supports(encoder, in_stream->codecpar->format) ||
+        !parse_hvcc(in_stream->codecpar->extradata, in_stream->codecpar->extradata_size, &sr.config))
+        return AVERROR(ENOSYS);
+
+    int64_t stream_start = in_stream->start_time != AV_NOPTS_VALUE ? in_stream->start_time : 0;
+    int64_t start_pts = stream_start + av_rescale_q(start_time, AV_TIME_BASE_Q, in_stream->time_base);
+    int64_t end_pts = end_time > 0 ?
+        stream_start + av_rescale_q(end_time, AV_TIME_BASE_Q, in_stream->time_base) : AV_NOPTS_VALUE;
+    sr.pts_offset = start_pts;
+
+    std::vector<IndexEntry> index;
+    bool hit_eof = false;
+    RenderPlan plan;
+    int ret = build_index(in_fmt_ctx, video_stream_index, start_pts, end_pts, &index, &hit_eof);
+    if (ret < 0 || !make_plan(index, hit_eof, start_pts, end_pts, &plan)) {
+        // Hand the input back untouched for a regular transcode
+        av_seek_frame(in_fmt_ctx, video_stream_index, stream_start, AVSEEK_FLAG_BACKWARD);
+        return ret < 0 && ret != AVERROR(ENOSYS) ? ret : AVERROR(ENOSYS);
+    }
+
+    if (avformat_alloc_output_context2(&sr.out_fmt_ctx, nullptr, "mp4", output_url) < 0) {
+        fprintf(stderr, "Could not create output context\n");
+        return AVERROR(ENOMEM);
+    }
+    sr.out_stream = avformat_new_stream(sr.out_fmt_ctx, nullptr);
+    if (!sr.out_stream || avcodec_parameters_copy(sr.out_stream->codecpar, in_stream->codecpar) < 0) {
+        fprintf(stderr, "Failed allocating output stream\n");
+        avformat_free_context(sr.out_fmt_ctx);
+        return AVERROR(ENOMEM);
+    }
+    // Parameter sets change at every splice, so they must travel in-band
+    sr.out_stream->codecpar->codec_tag = MKTAG('h', 'e', 'v', '1');
+    sr.out_stream->time_base = in_stream->time_base;
+    sr.out_stream->sample_aspect_ratio = in_stream->sample_aspect_ratio;
+
+    if (!(sr.out_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&sr.out_fmt_ctx->pb, output_url, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            fprintf(stderr, "Could not open output file '%s'\n", output_url);
+            avformat_free_context(sr.out_fmt_ctx);
+            return ret;
+        }
+    }
+    // The spliced stream is short next to a transcode, so the muxer's own
+    // rewrite after the trailer is cheap enough here
+    AVDictionary* mux_opts = nullptr;
+    if (faststart)
+        av_dict_set(&mux_opts, "movflags", "faststart", 0);
+    ret = avformat_write_header(sr.out_fmt_ctx, &mux_opts);
+    av_dict_free(&mux_opts);
+    if (ret < 0)
+        fprintf(stderr, "Error occurred when opening output file\n");
+    else
+        ret = render(in_fmt_ctx, video_stream_index, index, plan, start_pts, end_pts, &sr);
+    if (ret >= 0)
+        ret = av_write_trailer(sr.out_fmt_ctx);
+
+    if (!(sr.out_fmt_ctx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&sr.out_fmt_ctx->pb);
+    avformat_free_context(sr.out_fmt_ctx);
+    return ret;
+}
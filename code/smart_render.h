@@ -0,0 +1,26 @@
+#ifndef SMART_RENDER_H
+#define SMART_RENDER_H
+
+#include <cstdint>
+
+struct AVFormatContext;
+
+// Trims the HEVC stream `video_stream_index` of `in_fmt_ctx` to the range
+// [start_time, end_time) (microseconds from the start of the stream; an
+// end_time of 0 means the end of the input) and writes it to `output_url` as
+// an MP4, without re-encoding most of it:
+//   - whole GOPs inside the range are stream-copied,
+//   - only the partial GOPs at the two cut points are decoded and re-encoded.
+// The pieces are spliced with in-band parameter sets ('hev1'), and the first
+// copied CRA is relabelled as a BLA so decoders skip its missing leading
+// pictures, whose frames come from the re-encoded head instead. `output_url`
+// must be seekable; with `faststart` moov is moved in front of mdat.
+//
+// Returns 0 on success, AVERROR(ENOSYS) when the input cannot be smart-rendered
+// (non-seekable, Annex B extradata, a range inside a single GOP, ...) in which
+// case the input has been rewound and the caller should transcode normally, or
+// another negative AVERROR code on failure.
+int smart_render_hevc(AVFormatContext* in_fmt_ctx, int video_stream_index, const char* output_url,
+                      int64_t start_time, int64_t end_time, int thread_count, bool faststart);
+
+#endif // SMART_RENDER_H
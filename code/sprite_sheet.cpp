@@ -0,0 +1,264 @@
+#include "sprite_sheet.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Cue length used for the last tile when the stream's end is unknown and there
+// is no earlier gap to copy
+static const int64_t kDefaultCueUs = 1000000;
+
+struct SpriteSheetWriter {
+    std::string prefix;
+    int thumb_width;
+    int thumb_height;  // 0 until the first frame fixes the aspect ratio
+    int columns;
+    int rows;
+    int quality;
+    SwsContext* sws_ctx;
+    AVFrame* sheet;    // The sheet being filled, columns x rows tiles
+    int tiles;         // Tiles used on the current sheet
+    int sheet_number;  // 1-based number of the current sheet
+    FILE* index;
+    bool cue_pending;  // The last tile's cue is waiting for its end time
+    int64_t cue_start;
+    int64_t last_gap;
+    std::string cue_ref;
+};
+
+static std::string sheet_path(const SpriteSheetWriter* w, int number) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%03d.jpg", number);
+    return w->prefix + suffix;
+}
+
+static std::string base_name(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static void format_vtt_time(int64_t us, char* buf, size_t size) {
+    if (us < 0)
+        us = 0;
+    int64_t ms = us / 1000;
+    snprintf(buf, size, "%02d:%02d:%02d.%03d", (int)(ms / 3600000), (int)(ms / 60000 % 60),
+             (int)(ms / 1000 % 60), (int)(ms % 1000));
+}
+
+static void write_cue(SpriteSheetWriter* w, int64_t end_us) {
+    char start[32], end[32];
+    format_vtt_time(w->cue_start, start, sizeof(start));
+    format_vtt_time(end_us, end, sizeof(end));
+    fprintf(w->index, "%s --> %s\n%s\n\n", start, end, w->cue_ref.c_str());
+    w->cue_pending = false;
+}
+
+// Full-range black, so unused tiles on the last sheet do not show garbage
+static void clear_sheet(AVFrame* sheet) {
+    memset(sheet->data[0], 0, (size_t)sheet->linesize[0] * sheet->height);
+    memset(sheet->data[1], 128, (size_t)sheet->linesize[1] * (sheet->height / 2));
+    memset(sheet->data[2], 128, (size_t)sheet->linesize[2] * (sheet->height / 2));
+}
+
+// Encodes the used rows of the current sheet as a JPEG
+static int write_sheet(SpriteSheetWriter* w) {
+    if (w->tiles == 0)
+        return 0;
+    int used_rows = (w->tiles + w->columns - 1) / w->columns;
+    std::string path = sheet_path(w, w->sheet_number);
+    AVCodecContext* enc = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* pkt = nullptr;
+    FILE* file = nullptr;
+    int ret = 0;
+
+    const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (!encoder) {
+        fprintf(stderr, "JPEG encoder not found\n");
+        return AVERROR(EINVAL);
+    }
+    enc = avcodec_alloc_context3(encoder);
+    frame = av_frame_clone(w->sheet);
+    pkt = av_packet_alloc();
+    if (!enc || !frame || !pkt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    enc->width = w->sheet->width;
+    enc->height = used_rows * w->thumb_height;
+    enc->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    enc->color_range = AVCOL_RANGE_JPEG;
+    enc->time_base = AVRational{1, 1};
+    enc->flags |= AV_CODEC_FLAG_QSCALE;
+    enc->global_quality = FF_QP2LAMBDA * w->quality;
+    ret = avcodec_open2(enc, encoder, nullptr);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot open JPEG encoder\n");
+        goto end;
+    }
+
+    // Only the filled rows go into the image
+    frame->height = enc->height;
+    frame->quality = enc->global_quality;
+    frame->pts = 0;
+    ret = avcodec_send_frame(enc, frame);
+    if (ret >= 0)
+        ret = avcodec_send_frame(enc, nullptr);
+    if (ret >= 0)
+        ret = avcodec_receive_packet(enc, pkt);
+    if (ret < 0) {
+        fprintf(stderr, "Error encoding sprite sheet\n");
+        goto end;
+    }
+
+    file = fopen(path.c_str(), "wb");
+    if (!file || fwrite(pkt->data, 1, pkt->size, file) != (size_t)pkt->size) {
+        fprintf(stderr, "Could not write sprite sheet '%s'\n", path.c_str());
+        ret = AVERROR(EIO);
+    }
+    if (file && fclose(file) != 0 && ret >= 0) {
+        fprintf(stderr, "Could not write sprite sheet '%s'\n", path.c_str());
+        ret = AVERROR(EIO);
+    }
+
+end:
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    return ret;
+}
+
+// Sizes the tiles from the first frame's display aspect ratio
+static int setup_sheet(SpriteSheetWriter* w, const AVFrame* frame) {
+    AVRational sar = frame->sample_aspect_ratio;
+    if (sar.num <= 0 || sar.den <= 0)
+        sar = AVRational{1, 1};
+    int64_t height = av_rescale((int64_t)w->thumb_width * frame->height, sar.den,
+                                (int64_t)frame->width * sar.num);
+    // 4:2:0 tiles need even dimensions to sit on chroma sample boundaries
+    w->thumb_height = (int)((height + 1) & ~1);
+    if (w->thumb_height < 2)
+        w->thumb_height = 2;
+
+    w->sheet = av_frame_alloc();
+    if (!w->sheet)
+        return AVERROR(ENOMEM);
+    w->sheet->format = AV_PIX_FMT_YUVJ420P;
+    w->sheet->width = w->columns * w->thumb_width;
+    w->sheet->height = w->rows * w->thumb_height;
+    int ret = av_frame_get_buffer(w->sheet, 0);
+    if (ret < 0)
+        return ret;
+    clear_sheet(w->sheet);
+    return 0;
+}
+
+SpriteSheetWriter* sprite_sheet_open(const char* prefix, int thumb_width, int columns, int rows,
+                                     int quality) {
+    if (thumb_width < 2 || columns < 1 || rows < 1)
+        return nullptr;
+    std::string index_path = std::string(prefix) + ".vtt";
+    FILE* index = fopen(index_path.c_str(), "w");
+    if (!index) {
+        fprintf(stderr, "Could not open thumbnail index '%s'\n", index_path.c_str());
+        return nullptr;
+    }
+    fputs("WEBVTT\n\n", index);
+
+    SpriteSheetWriter* w = new SpriteSheetWriter();
+    w->prefix = prefix;
+    w->thumb_width = thumb_width & ~1;
+    w->thumb_height = 0;
+    w->columns = columns;
+    w->rows = rows;
+    w->quality = quality < 2 ? 2 : quality > 31 ? 31 : quality;
+    w->sws_ctx = nullptr;
+    w->sheet = nullptr;
+    w->tiles = 0;
+    w->sheet_number = 1;
+    w->index = index;
+    w->cue_pending = false;
+    w->cue_start = 0;
+    w->last_gap = 0;
+    return w;
+}
+
+int sprite_sheet_add(SpriteSheetWriter* w, const AVFrame* frame, int64_t time_us) {
+    int ret;
+    if (!w->sheet && (ret = setup_sheet(w, frame)) < 0)
+        return ret;
+
+    if (w->tiles == w->columns * w->rows) {
+        ret = write_sheet(w);
+        if (ret < 0)
+            return ret;
+        ret = av_frame_make_writable(w->sheet);
+        if (ret < 0)
+            return ret;
+        clear_sheet(w->sheet);
+        w->tiles = 0;
+        w->sheet_number++;
+    }
+
+    // Decoders can change resolution mid-stream, hence the cached context
+    w->sws_ctx = sws_getCachedContext(w->sws_ctx, frame->width, frame->height,
+                                      (enum AVPixelFormat)frame->format, w->thumb_width,
+                                      w->thumb_height, AV_PIX_FMT_YUVJ420P, SWS_BILINEAR,
+                                      nullptr, nullptr, nullptr);
+    if (!w->sws_ctx) {
+        fprintf(stderr, "Could not initialize the thumbnail scaler\n");
+        return AVERROR(EINVAL);
+    }
+
+    // Scale straight into the tile's place on the sheet
+    int x = (w->tiles % w->columns) * w->thumb_width;
+    int y = (w->tiles / w->columns) * w->thumb_height;
+    uint8_t* dst[4] = {
+        w->sheet->data[0] + y * w->sheet->linesize[0] + x,
+        w->sheet->data[1] + (y / 2) * w->sheet->linesize[1] + x / 2,
+        w->sheet->data[2] + (y / 2) * w->sheet->linesize[2] + x / 2,
+        nullptr
+    };
+    int dst_linesize[4] = { w->sheet->linesize[0], w->sheet->linesize[1], w->sheet->linesize[2], 0 };
+    sws_scale(w->sws_ctx, frame->data, frame->linesize, 0, frame->height, dst, dst_linesize);
+
+    if (w->cue_pending) {
+        if (time_us > w->cue_start)
+            w->last_gap = time_us - w->cue_start;
+        write_cue(w, time_us);
+    }
+    char ref[96];
+    snprintf(ref, sizeof(ref), "#xywh=%d,%d,%d,%d", x, y, w->thumb_width, w->thumb_height);
+    w->cue_ref = base_name(sheet_path(w, w->sheet_number)) + ref;
+    w->cue_start = time_us;
+    w->cue_pending = true;
+    w->tiles++;
+    return 0;
+}
+
+int sprite_sheet_close(SpriteSheetWriter** writer, int64_t end_us) {
+    SpriteSheetWriter* w = *writer;
+    if (!w)
+        return 0;
+    int ret = write_sheet(w);
+    if (w->cue_pending) {
+        if (end_us <= w->cue_start)
+            end_us = w->cue_start + (w->last_gap > 0 ? w->last_gap : kDefaultCueUs);
+        write_cue(w, end_us);
+    }
+    if (fclose(w->index) != 0 && ret >= 0) {
+        fprintf(stderr, "Could not write thumbnail index\n");
+        ret = AVERROR(EIO);
+    }
+    sws_freeContext(w->sws_ctx);
+    av_frame_free(&w->sheet);
+    delete w;
+    *writer = nullptr;
+    return ret;
+}
@@ -0,0 +1,30 @@
+#ifndef SPRITE_SHEET_H
+#define SPRITE_SHEET_H
+
+#include <cstdint>
+
+struct AVFrame;
+struct SpriteSheetWriter;
+
+// Packs scaled-down frames into a grid of JPEG sprite sheets for scrubbing
+// previews. Sheets are written as "<prefix>_001.jpg", "<prefix>_002.jpg", ...
+// and a WebVTT index "<prefix>.vtt" maps each time range to a tile
+// ("<prefix>_001.jpg#xywh=x,y,w,h"), the format most web players accept.
+
+// Tiles are `thumb_width` pixels wide; the height follows the display aspect
+// ratio of the first frame added. `quality` is the JPEG qscale (2 best, 31
+// worst). Returns nullptr on failure.
+SpriteSheetWriter* sprite_sheet_open(const char* prefix, int thumb_width, int columns, int rows,
+                                     int quality);
+
+// Scales `frame` into the next tile. `time_us` is the frame's presentation
+// time in microseconds from the start of the stream; its cue lasts until the
+// next frame added. Returns 0 or a negative AVERROR code.
+int sprite_sheet_add(SpriteSheetWriter* writer, const AVFrame* frame, int64_t time_us);
+
+// Writes the last (possibly partial) sheet, ends the last cue at `end_us`
+// (ignored when not after it) and frees the writer. Returns 0 or a negative
+// AVERROR code.
+int sprite_sheet_close(SpriteSheetWriter** writer, int64_t end_us);
+
+#endif // SPRITE_SHEET_H
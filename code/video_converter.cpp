@@ -1,255 +1,1165 @@
-#include "video_converter.h"
-
-extern "C" {
-#include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
-#include <libavutil/opt.h>
-#include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
-}
-
-#include <cstdio>
-
-void convert_video_to_h265(const char* input_file, const char* output_file, int thread_count) {
-    int ret = 0; // Declare at the top to avoid goto crossing initialization
-
-    // Open the input file
-    AVFormatContext* in_fmt_ctx = nullptr;
-    if (avformat_open_input(&in_fmt_ctx, input_file, nullptr, nullptr) < 0) {
-        fprintf(stderr, "Could not open input file '%s'\n", input_file);
-        return;
-    }
-    if (avformat_find_stream_info(in_fmt_ctx, nullptr) < 0) {
-        fprintf(stderr, "Failed to retrieve input stream information\n");
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Find the best video stream
-    int video_stream_index = av_find_best_stream(in_fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-    if (video_stream_index < 0) {
-        fprintf(stderr, "Failed to find video stream in input file\n");
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-    AVStream* in_video_stream = in_fmt_ctx->streams[video_stream_index];
-
-    // Open the decoder for the video stream
-    const AVCodec* decoder = avcodec_find_decoder(in_video_stream->codecpar->codec_id);
-    if (!decoder) {
-        fprintf(stderr, "Decoder not found\n");
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-    AVCodecContext* dec_ctx = avcodec_alloc_context3(decoder);
-    if (!dec_ctx) {
-        fprintf(stderr, "Could not allocate decoder context\n");
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-    if (avcodec_parameters_to_context(dec_ctx, in_video_stream->codecpar) < 0) {
-        fprintf(stderr, "Failed to copy decoder parameters to input decoder context\n");
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-    if (avcodec_open2(dec_ctx, decoder, nullptr) < 0) {
-        fprintf(stderr, "Failed to open decoder for stream\n");
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Allocate the output format context (using MP4 container)
-    AVFormatContext* out_fmt_ctx = nullptr;
-    if (avformat_alloc_output_context2(&out_fmt_ctx, nullptr, "mp4", output_file) < 0) {
-        fprintf(stderr, "Could not create output context\n");
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Find the H.265 encoder (HEVC)
-    const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_HEVC);
-    if (!encoder) {
-        fprintf(stderr, "Necessary encoder not found\n");
-        avformat_free_context(out_fmt_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Create a new video stream in the output file
-    AVStream* out_stream = avformat_new_stream(out_fmt_ctx, nullptr);
-    if (!out_stream) {
-        fprintf(stderr, "Failed allocating output stream\n");
-        avformat_free_context(out_fmt_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Allocate and configure the encoder context
-    AVCodecContext* enc_ctx = avcodec_alloc_context3(encoder);
-    if (!enc_ctx) {
-        fprintf(stderr, "Failed to allocate the encoder context\n");
-        avformat_free_context(out_fmt_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Set encoder parameters. You can tweak these values.
-    enc_ctx->height = dec_ctx->height;
-    enc_ctx->width = dec_ctx->width;
-    enc_ctx->sample_aspect_ratio = dec_ctx->sample_aspect_ratio;
-    // Use YUV420P pixel format (commonly used by H.265)
-    enc_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    enc_ctx->time_base = av_inv_q(dec_ctx->framerate.num ? dec_ctx->framerate : in_video_stream->r_frame_rate);
-    // Set preset options if supported
-    av_opt_set(enc_ctx->priv_data, "preset", "medium", 0);
-    // Set the number of threads via AVOptions
-    av_opt_set_int(enc_ctx->priv_data, "threads", thread_count, 0);
-    
-    // Open the encoder
-    if (avcodec_open2(enc_ctx, encoder, nullptr) < 0) {
-        fprintf(stderr, "Cannot open video encoder for stream\n");
-        avcodec_free_context(&enc_ctx);
-        avformat_free_context(out_fmt_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Copy encoder parameters to the output stream
-    if (avcodec_parameters_from_context(out_stream->codecpar, enc_ctx) < 0) {
-        fprintf(stderr, "Failed to copy encoder parameters to output stream\n");
-        avcodec_free_context(&enc_ctx);
-        avformat_free_context(out_fmt_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-    out_stream->time_base = enc_ctx->time_base;
-
-    // Open the output file if needed
-    if (!(out_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&out_fmt_ctx->pb, output_file, AVIO_FLAG_WRITE) < 0) {
-            fprintf(stderr, "Could not open output file '%s'\n", output_file);
-            avcodec_free_context(&enc_ctx);
-            avformat_free_context(out_fmt_ctx);
-            avcodec_free_context(&dec_ctx);
-            avformat_close_input(&in_fmt_ctx);
-            return;
-        }
-    }
-
-    // Write the stream header to the output file
-    if (avformat_write_header(out_fmt_ctx, nullptr) < 0) {
-        fprintf(stderr, "Error occurred when opening output file\n");
-        if (!(out_fmt_ctx->oformat->flags & AVFMT_NOFILE))
-            avio_closep(&out_fmt_ctx->pb);
-        avcodec_free_context(&enc_ctx);
-        avformat_free_context(out_fmt_ctx);
-        avcodec_free_context(&dec_ctx);
-        avformat_close_input(&in_fmt_ctx);
-        return;
-    }
-
-    // Allocate frames and packets for conversion
-    AVFrame* frame_decoded = av_frame_alloc();
-    AVFrame* frame_converted = av_frame_alloc();
-    AVPacket* packet_in = av_packet_alloc();
-    AVPacket* packet_out = av_packet_alloc();
-
-    // Prepare a scaler if the decoder pixel format isn't YUV420P (required by our encoder)
-    struct SwsContext* sws_ctx = sws_getContext(dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt,
-                                                enc_ctx->width, enc_ctx->height, enc_ctx->pix_fmt,
-                                                SWS_BICUBIC, nullptr, nullptr, nullptr);
-    if (!sws_ctx) {
-        fprintf(stderr, "Could not initialize the conversion context\n");
-        goto cleanup;
-    }
-
-    // Allocate buffer for the converted frame
-    ret = av_image_alloc(frame_converted->data, frame_converted->linesize,
-                         enc_ctx->width, enc_ctx->height, enc_ctx->pix_fmt, 32);
-    if (ret < 0) {
-        fprintf(stderr, "Could not allocate raw picture buffer\n");
-        goto cleanup;
-    }
-    frame_converted->width  = enc_ctx->width;
-    frame_converted->height = enc_ctx->height;
-    frame_converted->format = enc_ctx->pix_fmt;
-    frame_converted->pts = 0;
-
-    // Main conversion loop: read, decode, convert, encode, and write
-    while (av_read_frame(in_fmt_ctx, packet_in) >= 0) {
-        if (packet_in->stream_index == video_stream_index) {
-            ret = avcodec_send_packet(dec_ctx, packet_in);
-            if (ret < 0) {
-                fprintf(stderr, "Error sending packet for decoding\n");
-                break;
-            }
-            while (ret >= 0) {
-                ret = avcodec_receive_frame(dec_ctx, frame_decoded);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                    break;
-                else if (ret < 0) {
-                    fprintf(stderr, "Error during decoding\n");
-                    goto cleanup;
-                }
-
-                // Convert the frame to the encoder's pixel format
-                sws_scale(sws_ctx, frame_decoded->data, frame_decoded->linesize, 0, dec_ctx->height,
-                          frame_converted->data, frame_converted->linesize);
-                frame_converted->pts = frame_decoded->pts;
-
-                // Encode the frame
-                ret = avcodec_send_frame(enc_ctx, frame_converted);
-                if (ret < 0) {
-                    fprintf(stderr, "Error sending frame for encoding\n");
-                    goto cleanup;
-                }
-                while (ret >= 0) {
-                    ret = avcodec_receive_packet(enc_ctx, packet_out);
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                        break;
-                    else if (ret < 0) {
-                        fprintf(stderr, "Error during encoding\n");
-                        goto cleanup;
-                    }
-                    // Rescale packet timestamp
-                    av_packet_rescale_ts(packet_out, enc_ctx->time_base, out_stream->time_base);
-                    packet_out->stream_index = out_stream->index;
-                    // Write packet
-                    if (av_interleaved_write_frame(out_fmt_ctx, packet_out) < 0) {
-                        fprintf(stderr, "Error while writing output packet\n");
-                        goto cleanup;
-                    }
-                    av_packet_unref(packet_out);
-                }
-                av_frame_unref(frame_decoded);
-            }
-        }
-        av_packet_unref(packet_in);
-    }
-
-    // Write trailer to output file
-    av_write_trailer(out_fmt_ctx);
-
-cleanup:
-    if (sws_ctx)
-        sws_freeContext(sws_ctx);
-    av_freep(&frame_converted->data[0]);
-    av_frame_free(&frame_converted);
-    av_frame_free(&frame_decoded);
-    av_packet_free(&packet_in);
-    av_packet_free(&packet_out);
-    if (out_fmt_ctx && !(out_fmt_ctx->oformat->flags & AVFMT_NOFILE))
-        avio_closep(&out_fmt_ctx->pb);
-    avcodec_free_context(&enc_ctx);
-    avcodec_free_context(&dec_ctx);
-    avformat_close_input(&in_fmt_ctx);
-    avformat_free_context(out_fmt_ctx);
-}
+#include "video_converter.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include "async_io.h"
+#include "crop_detect.h"
+#include "duplicate_detect.h"
+#include "filter_stage.h"
+#include "frame_stats.h"
+#include "input_file.h"
+#include "logo_overlay.h"
+#include "packet_index.h"
+#include "scaler_cache.h"
+#include "scene_detect.h"
+#include "side_outputs.h"
+#include "smart_render.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+// "-" writes to standard output
+static const char* output_url(const char* path) {
+    return strcmp(path, "-") == 0 ? "pipe:1" : path;
+}
+
+// True for outputs the muxer cannot seek back into (pipes, FIFOs, devices)
+static bool is_streamed_output(const char* url) {
+    if (strncmp(url, "pipe:", 5) == 0)
+        return true;
+    struct stat st;
+    return stat(url, &st) == 0 && (st.st_mode & S_IFMT) != S_IFREG;
+}
+
+// Container muxer for the requested output layout. The segmenting muxers write
+// their playlists and segments themselves, next to output_file.
+static const char* output_muxer_name(const VideoConverterOptions* options) {
+    switch (options->segment_format) {
+    case VIDEO_CONVERTER_SEGMENTS_HLS:
+        return "hls";
+    case VIDEO_CONVERTER_SEGMENTS_DASH:
+    case VIDEO_CONVERTER_SEGMENTS_HLS_DASH:
+        return "dash";
+    default:
+        return "mp4";
+    }
+}
+
+// CMAF-style fMP4 segments for HLS and/or DASH
+static void set_segment_muxer_options(AVDictionary** mux_opts, const VideoConverterOptions* options) {
+    char duration[32];
+    snprintf(duration, sizeof(duration), "%.3f", options->segment_duration);
+    if (options->segment_format == VIDEO_CONVERTER_SEGMENTS_HLS) {
+        av_dict_set(mux_opts, "hls_segment_type", "fmp4", 0);
+        av_dict_set(mux_opts, "hls_time", duration, 0);
+        av_dict_set(mux_opts, "hls_playlist_type", "vod", 0);
+        av_dict_set(mux_opts, "hls_flags", "independent_segments", 0);
+    } else {
+        av_dict_set(mux_opts, "seg_duration", duration, 0);
+        av_dict_set(mux_opts, "dash_segment_type", "mp4", 0);
+        av_dict_set(mux_opts, "use_template", "1", 0);
+        av_dict_set(mux_opts, "use_timeline", "1", 0);
+        // HLS playlists referencing the same segments, so one encode serves both
+        if (options->segment_format == VIDEO_CONVERTER_SEGMENTS_HLS_DASH)
+            av_dict_set(mux_opts, "hls_playlist", "1", 0);
+    }
+}
+
+// Space reserved per video sample when placing moov up front: worst-case
+// stsz/stts/ctts/co64 entries plus sdtp, and a fixed allowance for the rest of
+// the box tree (hvcC, edit lists, handler and metadata boxes).
+static const int64_t kMoovBytesPerSample = 32;
+static const int64_t kMoovFixedBytes = 64 * 1024;
+
+// Generous upper bound for the moov box of a transcode of in_video_stream to
+// frame_rate, or 0 when the input's length is unknown (e.g. a pipe).
+static int64_t estimate_moov_size(AVFormatContext* in_fmt_ctx, AVStream* in_video_stream,
+                                  AVRational frame_rate, const VideoConverterOptions* options) {
+    // The filter graph and max_fps change how many frames come out, so the
+    // input's frame count is scaled to the output rate
+    AVRational in_frame_rate = av_guess_frame_rate(in_fmt_ctx, in_video_stream, nullptr);
+    int64_t frames = 0;
+    if (in_video_stream->nb_frames > 0 && in_frame_rate.num > 0 && in_frame_rate.den > 0)
+        frames = av_rescale_q(in_video_stream->nb_frames, frame_rate, in_frame_rate);
+    if (frames <= 0 || options->start_time > 0 || options->end_time > 0) {
+        int64_t duration = in_fmt_ctx->duration;
+        if (in_video_stream->duration > 0)
+            duration = av_rescale_q(in_video_stream->duration, in_video_stream->time_base, AV_TIME_BASE_Q);
+        // Only the requested range ends up in the output
+        if (options->end_time > 0 && (duration <= 0 || options->end_time < duration))
+            duration = options->end_time;
+        duration -= options->start_time;
+        if (duration <= 0)
+            return 0;
+        frames = av_rescale_q(duration, AV_TIME_BASE_Q, av_inv_q(frame_rate));
+    }
+    // Slack for variable frame rate sources and container duration rounding
+    frames += frames / 4 + 16;
+    return kMoovFixedBytes + frames * kMoovBytesPerSample;
+}
+
+// Write-behind output only takes regular files; pipes and URLs fall back to avio_open
+static int open_output_io(AVFormatContext* out_fmt_ctx, const char* path,
+                          const VideoConverterOptions* options) {
+    if (options->async_io && !is_streamed_output(path)) {
+        out_fmt_ctx->pb = async_output_open(path, options->output_buffer_size, options->direct_io);
+        if (out_fmt_ctx->pb) {
+            out_fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+            return 0;
+        }
+    }
+    return avio_open(&out_fmt_ctx->pb, path, AVIO_FLAG_WRITE);
+}
+
+static void close_output_io(AVFormatContext* out_fmt_ctx, const VideoConverterOptions* options) {
+    if (!(out_fmt_ctx->flags & AVFMT_FLAG_CUSTOM_IO)) {
+        avio_closep(&out_fmt_ctx->pb);
+        return;
+    }
+    // Write-behind errors only surface once everything has been flushed
+    AsyncOutputStats io_stats = {};
+    if (async_output_close(&out_fmt_ctx->pb, &io_stats) < 0)
+        fprintf(stderr, "Error while writing output file\n");
+    if (options->stats) {
+        options->stats->output_bytes_written = io_stats.bytes_written;
+        options->stats->output_blocked_us = io_stats.blocked_us;
+        options->stats->output_blocked_waits = io_stats.blocked_waits;
+    }
+}
+
+// Decoder shortcuts for proxy mode. Decoding at 1/2^n resolution (only some
+// codecs, e.g. MJPEG, MPEG-4 part 2) is used as far as it stays above the
+// proxy height. Skipping the loop filter lets artifacts propagate a little
+// through references, skipping the IDCT is limited to frames nothing refers
+// to; neither matters at proxy quality.
+static void set_proxy_decoder_options(AVCodecContext* dec_ctx, const AVCodec* decoder,
+                                      int coded_height, int proxy_height) {
+    int lowres = 0;
+    while (lowres < decoder->max_lowres && (coded_height >> (lowres + 1)) >= proxy_height)
+        lowres++;
+    dec_ctx->lowres = lowres;
+    dec_ctx->skip_loop_filter = AVDISCARD_ALL;
+    dec_ctx->skip_idct = AVDISCARD_NONREF;
+    dec_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+}
+
+// Shrinks `width` x `height` in place to fit within max_width x max_height
+// (0 for no limit on that axis), keeping the aspect ratio. Dimensions stay
+// even for 4:2:0.
+static void cap_output_size(int max_width, int max_height, int* width, int* height) {
+    int w = *width;
+    int h = *height;
+    if (max_width > 0 && w > max_width) {
+        h = (int)av_rescale(h, max_width, w);
+        w = max_width;
+    }
+    if (max_height > 0 && h > max_height) {
+        w = (int)av_rescale(w, max_height, h);
+        h = max_height;
+    }
+    *width = w > 1 ? w & ~1 : 2;
+    *height = h > 1 ? h & ~1 : 2;
+}
+
+// 10-bit sources are encoded as main10 (yuv420p10) rather than squeezed
+// through 8 bits, as long as the encoder build supports it. Everything else
+// stays 8-bit yuv420p.
+static enum AVPixelFormat select_output_format(const AVCodec* encoder, enum AVPixelFormat source_format,
+                                               const VideoConverterOptions* options) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(source_format);
+    if (!options->high_bit_depth || options->proxy_mode || !desc || desc->comp[0].depth <= 8)
+        return AV_PIX_FMT_YUV420P;
+    if (encoder->pix_fmts) {
+        for (const enum AVPixelFormat* fmt = encoder->pix_fmts; *fmt != AV_PIX_FMT_NONE; fmt++)
+            if (*fmt == AV_PIX_FMT_YUV420P10)
+                return AV_PIX_FMT_YUV420P10;
+        fprintf(stderr, "Encoder has no 10-bit support, encoding %d-bit input as 8-bit\n",
+                desc->comp[0].depth);
+        return AV_PIX_FMT_YUV420P;
+    }
+    return AV_PIX_FMT_YUV420P10;
+}
+
+// Carries the source's color description over to the encoder so the output
+// VUI (and HDR metadata, where the libraries pass it on) matches the input.
+// Range and matrix describe the samples after conversion from
+// `source_format`, the format reaching the scaler: yuvj and RGB input comes
+// out of swscale (and the yuvj420p kernel) as limited range YUV, with RGB
+// converted by swscale's default BT.601 matrix. Other YUV input keeps its
+// samples, and so its tags.
+static void copy_color_properties(AVCodecContext* enc_ctx, const AVCodecContext* dec_ctx,
+                                  enum AVPixelFormat source_format) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(source_format);
+    bool rgb = desc && (desc->flags & AV_PIX_FMT_FLAG_RGB);
+    bool full_range_format = source_format == AV_PIX_FMT_YUVJ420P || source_format == AV_PIX_FMT_YUVJ422P ||
+        source_format == AV_PIX_FMT_YUVJ444P || source_format == AV_PIX_FMT_YUVJ440P ||
+        source_format == AV_PIX_FMT_YUVJ411P;
+    enc_ctx->color_range = rgb || full_range_format ? AVCOL_RANGE_MPEG : dec_ctx->color_range;
+    enc_ctx->colorspace = rgb ? AVCOL_SPC_SMPTE170M : dec_ctx->colorspace;
+    if (enc_ctx->colorspace == AVCOL_SPC_RGB)
+        enc_ctx->colorspace = AVCOL_SPC_UNSPECIFIED;
+    enc_ctx->color_primaries = dec_ctx->color_primaries;
+    enc_ctx->color_trc = dec_ctx->color_trc;
+    enc_ctx->chroma_sample_location = dec_ctx->chroma_sample_location;
+#if LIBAVCODEC_VERSION_MAJOR >= 61
+    // Static HDR10 metadata from the container; libx265 writes it as SEI
+    static const enum AVFrameSideDataType hdr_types[] = {
+        AV_FRAME_DATA_MASTERING_DISPLAY_METADATA,
+        AV_FRAME_DATA_CONTENT_LIGHT_LEVEL,
+    };
+    for (enum AVFrameSideDataType type : hdr_types) {
+        const AVFrameSideData* sd =
+            av_frame_side_data_get(dec_ctx->decoded_side_data, dec_ctx->nb_decoded_side_data, type);
+        if (sd && av_frame_side_data_clone(&enc_ctx->decoded_side_data, &enc_ctx->nb_decoded_side_data,
+                                           sd, 0) < 0)
+            fprintf(stderr, "Could not copy HDR metadata to the encoder\n");
+    }
+#endif
+}
+
+// Picture area of the decoded frames, without black bars
+struct CropArea {
+    int x;
+    int y;
+    int width;                // 0 when nothing is cropped
+    int height;
+    int source_width;         // Frame size the area applies to
+    int source_height;
+};
+
+// Bit depth of a pixel format's luma plane when it is one the crop and
+// duplicate detectors can read (8 to 15 bits, one native little-endian,
+// LSB-aligned sample per pixel, plane 0), otherwise 0. MSB-aligned formats
+// such as P010 reach 65472, which the detectors' signed sums read as negative.
+static int luma_bit_depth(int format) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL |
+                                 AV_PIX_FMT_FLAG_BE)) ||
+        desc->comp[0].plane != 0 || desc->comp[0].shift != 0 || desc->comp[0].depth > 15 ||
+        desc->comp[0].step != (desc->comp[0].depth > 8 ? 2 : 1))
+        return 0;
+    return desc->comp[0].depth;
+}
+
+// Frames sampled across the input for crop detection, and the packets read
+// at most to get each one out of the decoder
+static const int kCropSamples = 8;
+static const int kCropMaxPackets = 256;
+
+// Times the rewind target is moved further back before falling back to a
+// seek to byte 0
+static const int kRewindAttempts = 4;
+
+// Reads up to the first packet of `stream_index` and returns its decoding
+// timestamp, or AV_NOPTS_VALUE if there is none
+static int64_t first_packet_dts(AVFormatContext* in_fmt_ctx, int stream_index, AVPacket* packet) {
+    for (int packets = 0; packets < kCropMaxPackets; packets++) {
+        if (av_read_frame(in_fmt_ctx, packet) < 0)
+            break;
+        if (packet->stream_index == stream_index) {
+            int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+            av_packet_unref(packet);
+            return dts;
+        }
+        av_packet_unref(packet);
+    }
+    return AV_NOPTS_VALUE;
+}
+
+// Seeks back to the first packet of the video stream. Timestamp seeks are
+// not exact in every demuxer (MPEG-TS, streams whose first keyframe is not at
+// the start time) and can land past it, so where the seek lands is checked
+// and the target moved back until it is early enough. Byte 0 is the last
+// resort, for demuxers that allow byte seeks.
+static int rewind_input(AVFormatContext* in_fmt_ctx, int stream_index, AVPacket* packet) {
+    int64_t first = in_fmt_ctx->streams[stream_index]->start_time;
+    int64_t target = in_fmt_ctx->start_time == AV_NOPTS_VALUE ? 0 : in_fmt_ctx->start_time;
+    int64_t step = AV_TIME_BASE;
+    for (int attempt = 0; attempt < kRewindAttempts; attempt++) {
+        if (avformat_seek_file(in_fmt_ctx, -1, INT64_MIN, target, target, 0) < 0)
+            break;
+        if (first == AV_NOPTS_VALUE || !packet)
+            return 0;
+        int64_t landed = first_packet_dts(in_fmt_ctx, stream_index, packet);
+        // Seeking to the same target lands on the same packet again
+        if (landed == AV_NOPTS_VALUE || landed <= first)
+            return avformat_seek_file(in_fmt_ctx, -1, INT64_MIN, target, target, 0);
+        target -= step;
+        step *= 2;
+    }
+    return avformat_seek_file(in_fmt_ctx, -1, 0, 0, 0, AVSEEK_FLAG_BYTE);
+}
+
+// Looks for black bars in frames decoded at evenly spaced points of a
+// seekable input, then rewinds the input and the decoder to the beginning.
+// Returns 1 with `crop` filled in, 0 when there is nothing to crop or the
+// input cannot be sampled, or a negative AVERROR code if the input could not
+// be rewound.
+static int detect_crop(AVFormatContext* in_fmt_ctx, int stream_index, AVCodecContext* dec_ctx,
+                       CropArea* crop) {
+    if (in_fmt_ctx->duration <= 0 || (in_fmt_ctx->pb && !in_fmt_ctx->pb->seekable))
+        return 0;
+    int64_t start = in_fmt_ctx->start_time == AV_NOPTS_VALUE ? 0 : in_fmt_ctx->start_time;
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+    CropDetector* detector = nullptr;
+    int width = 0;
+    int height = 0;
+    int ret = 0;
+    if (!frame || !packet)
+        goto done;
+
+    for (int i = 1; i <= kCropSamples; i++) {
+        int64_t target = start + in_fmt_ctx->duration * i / (kCropSamples + 1);
+        if (avformat_seek_file(in_fmt_ctx, -1, INT64_MIN, target, target, 0) < 0)
+            break;
+        avcodec_flush_buffers(dec_ctx);
+        bool got_frame = false;
+        for (int packets = 0; !got_frame && packets < kCropMaxPackets; packets++) {
+            if (av_read_frame(in_fmt_ctx, packet) < 0)
+                break;
+            if (packet->stream_index == stream_index && avcodec_send_packet(dec_ctx, packet) >= 0)
+                got_frame = avcodec_receive_frame(dec_ctx, frame) >= 0;
+            av_packet_unref(packet);
+        }
+        if (!got_frame)
+            continue;
+
+        int bit_depth = luma_bit_depth(frame->format);
+        if (bit_depth > 0) {
+            if (!detector) {
+                width = frame->width;
+                height = frame->height;
+                detector = crop_detector_create(width, height, bit_depth);
+            }
+            if (detector && frame->width == width && frame->height == height)
+                crop_detector_add(detector, frame->data[0], frame->linesize[0]);
+        }
+        av_frame_unref(frame);
+    }
+
+    if (detector && crop_detector_get(detector, &crop->x, &crop->y, &crop->width, &crop->height)) {
+        crop->source_width = width;
+        crop->source_height = height;
+        ret = 1;
+    }
+
+done:
+    if (rewind_input(in_fmt_ctx, stream_index, packet) < 0) {
+        fprintf(stderr, "Could not rewind the input after crop detection\n");
+        ret = AVERROR(EIO);
+    }
+    avcodec_flush_buffers(dec_ctx);
+    crop_detector_free(&detector);
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    return ret;
+}
+
+// Input geometries (size and pixel format) whose scalers are kept around
+static const int kScalerCacheSize = 4;
+
+// How output byte offsets are known for the packet index
+enum IndexOffsets {
+    INDEX_OFFSETS_EXACT,    // Regular MP4: samples are written as they are muxed
+    INDEX_OFFSETS_FRAGMENT, // Fragmented MP4: samples are buffered until their fragment is flushed
+    INDEX_OFFSETS_NONE      // Segmented output: offsets are per segment file
+};
+
+// Picture type the encoder reported in the packet's quality stats side data
+static uint8_t packet_pict_type(const AVPacket* pkt) {
+    size_t size = 0;
+    const uint8_t* stats = av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_STATS, &size);
+    return stats && size >= 5 ? stats[4] : (uint8_t)AV_PICTURE_TYPE_NONE;
+}
+
+// Everything the per-frame stages of the conversion loop need
+struct TranscodeState {
+    AVStream* in_stream;
+    AVCodecContext* dec_ctx;
+    AVCodecContext* enc_ctx;
+    AVFormatContext* out_fmt_ctx;
+    AVStream* out_stream;
+    ScalerCache* scaler;      // Scaler per input geometry, for mid-stream changes
+    AVFrame* frame_converted;
+    AVPacket* packet_out;
+    int64_t segment_pts;      // Segment length in encoder time base, 0 when not segmenting
+    int64_t next_segment_pts; // Next frame to be forced to IDR
+    int64_t start_pts;        // Requested range in input stream time base, or AV_NOPTS_VALUE
+    int64_t end_pts;
+    int64_t pts_offset;       // Subtracted from input timestamps so clips start at zero
+    bool reached_end;         // A frame past end_pts has been decoded
+    int64_t last_pts;         // Encoder pts of the last frame kept, or AV_NOPTS_VALUE
+    SideOutputs* side_outputs; // Thumbnails and preview, or nullptr
+    PacketIndexWriter* packet_index; // Seek index sidecar, or nullptr
+    IndexOffsets index_offsets;
+    int64_t fragment_offset;  // Output position of the fragment being filled
+    FrameStatsWriter* frame_stats; // Per-frame encoder stats, or nullptr
+    SceneDetector* scene_detector; // Forces IDRs at shot changes, or nullptr
+    FILE* scene_cuts;         // Cut times for chunked encoding, or nullptr
+    CropArea crop;            // Black bars removed before scaling
+    FilterStage* filter;      // Preprocessing filter graph, or nullptr
+    AVFrame* frame_filtered;
+    AVRational frame_time_base; // Time base of the frames reaching the scaler
+    int64_t frame_pts_offset; // pts_offset in frame_time_base
+    DuplicateDetector* duplicate_detector; // Drops repeated frames, or nullptr
+    int64_t repeat_pts;       // Encoder pts of a duplicate dropped after the last frame kept
+    LogoOverlay* logo;        // Blended onto every encoded frame, or nullptr
+    VideoConverterStats* stats;
+};
+
+// Sends `frame` to the encoder (nullptr flushes it) and muxes every packet it returns
+static int encode_frame(TranscodeState* ts, AVFrame* frame) {
+    if (ts->frame_stats && frame)
+        frame_stats_frame_sent(ts->frame_stats, frame->pts);
+    int ret = avcodec_send_frame(ts->enc_ctx, frame);
+    if (ret < 0) {
+        fprintf(stderr, "Error sending frame for encoding\n");
+        return ret;
+    }
+    for (;;) {
+        ret = avcodec_receive_packet(ts->enc_ctx, ts->packet_out);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        else if (ret < 0) {
+            fprintf(stderr, "Error during encoding\n");
+            return ret;
+        }
+        if (ts->frame_stats && frame_stats_packet(ts->frame_stats, ts->packet_out) < 0) {
+            fprintf(stderr, "Error writing frame stats, disabling them\n");
+            frame_stats_close(&ts->frame_stats);
+        }
+        // Rescale packet timestamp
+        av_packet_rescale_ts(ts->packet_out, ts->enc_ctx->time_base, ts->out_stream->time_base);
+        ts->packet_out->stream_index = ts->out_stream->index;
+        // The muxer takes the packet, so fill in the index record first
+        PacketIndexEntry entry;
+        int64_t pos_before = 0;
+        if (ts->packet_index) {
+            entry.pts = ts->packet_out->pts;
+            entry.dts = ts->packet_out->dts;
+            entry.offset = kPacketIndexUnknownOffset;
+            entry.size = ts->packet_out->size;
+            entry.pict_type = packet_pict_type(ts->packet_out);
+            entry.key = ts->packet_out->flags & AV_PKT_FLAG_KEY;
+            if (ts->index_offsets != INDEX_OFFSETS_NONE)
+                pos_before = avio_tell(ts->out_fmt_ctx->pb);
+        }
+        // Write packet
+        ret = av_interleaved_write_frame(ts->out_fmt_ctx, ts->packet_out);
+        av_packet_unref(ts->packet_out);
+        if (ret < 0) {
+            fprintf(stderr, "Error while writing output packet\n");
+            return ret;
+        }
+        if (ts->packet_index) {
+            // With a single stream the interleaver passes packets straight
+            // through, so the muxer's position moves only for this packet
+            int64_t pos_after = ts->index_offsets != INDEX_OFFSETS_NONE ? avio_tell(ts->out_fmt_ctx->pb) : 0;
+            if (ts->index_offsets == INDEX_OFFSETS_EXACT) {
+                entry.offset = pos_before;
+                entry.size = (uint32_t)(pos_after - pos_before);
+            } else if (ts->index_offsets == INDEX_OFFSETS_FRAGMENT) {
+                // Samples are held in memory, so the position only moves when
+                // this packet made the muxer flush the previous fragment and
+                // open a new one here
+                if (pos_after != pos_before)
+                    ts->fragment_offset = pos_after;
+                entry.offset = ts->fragment_offset;
+            }
+            if (packet_index_add(ts->packet_index, &entry) < 0) {
+                fprintf(stderr, "Error writing packet index, disabling it\n");
+                packet_index_close(&ts->packet_index);
+            }
+        }
+    }
+}
+
+// Converts a decoded (or filtered) frame to the encoder's format and encodes it
+static int encode_picture(TranscodeState* ts, AVFrame* frame) {
+    // Thumbnails and the preview are cut from the same frames
+    if (ts->side_outputs)
+        side_outputs_push(ts->side_outputs, frame, frame->pts == AV_NOPTS_VALUE ?
+                          AV_NOPTS_VALUE : frame->pts - ts->frame_pts_offset);
+
+    // Timestamps are in the input stream's time base, or the filter graph's
+    // output time base. A frame that lands on an encoder tick already taken
+    // is dropped before any conversion work: with max_fps this decimates the
+    // source to the capped rate, and otherwise it catches variable-frame-rate
+    // bunching that would give the muxer duplicate timestamps.
+    int64_t pts = frame->pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+        av_rescale_q(frame->pts - ts->frame_pts_offset, ts->frame_time_base, ts->enc_ctx->time_base);
+    if (pts != AV_NOPTS_VALUE) {
+        if (ts->last_pts != AV_NOPTS_VALUE && pts <= ts->last_pts) {
+            if (ts->stats)
+                ts->stats->frames_dropped++;
+            return 0;
+        }
+        // A frame repeating the last one kept is left out and the kept frame
+        // lasts longer, making static content variable frame rate. Frames
+        // due to start a segment are always kept.
+        int bit_depth = luma_bit_depth(frame->format);
+        if (ts->duplicate_detector && bit_depth > 0 &&
+            !(ts->segment_pts > 0 && pts >= ts->next_segment_pts) &&
+            duplicate_detector_is_duplicate(ts->duplicate_detector, frame->data[0], frame->linesize[0],
+                                            frame->width, frame->height, bit_depth)) {
+            ts->repeat_pts = pts;
+            if (ts->stats)
+                ts->stats->duplicates_dropped++;
+            return 0;
+        }
+        ts->last_pts = pts;
+        ts->repeat_pts = AV_NOPTS_VALUE;
+    }
+
+    AVFrame* frame_converted = ts->frame_converted;
+    // Convert the frame to the encoder's size and pixel format, whatever its
+    // geometry is now. The encoder has normally let go of the previous frame,
+    // so this rarely copies.
+    int ret = av_frame_make_writable(frame_converted);
+    if (ret >= 0)
+        ret = scaler_cache_scale(ts->scaler, frame, frame_converted);
+    if (ret < 0) {
+        fprintf(stderr, "Error converting frame\n");
+        return ret;
+    }
+    frame_converted->pts = pts;
+
+    // Force an IDR on the first frame at or past each segment boundary
+    frame_converted->pict_type = AV_PICTURE_TYPE_NONE;
+    if (ts->segment_pts > 0 && frame_converted->pts != AV_NOPTS_VALUE &&
+        frame_converted->pts >= ts->next_segment_pts) {
+        frame_converted->pict_type = AV_PICTURE_TYPE_I;
+        while (ts->next_segment_pts <= frame_converted->pts)
+            ts->next_segment_pts += ts->segment_pts;
+    }
+    // New scenes start with an IDR: the cut costs an intra frame anyway, and
+    // chunks split there encode independently
+    if (ts->scene_detector &&
+        scene_detector_is_cut(ts->scene_detector, frame_converted->data[0], frame_converted->linesize[0],
+                              frame_converted->width, frame_converted->height,
+                              frame_converted->format == AV_PIX_FMT_YUV420P10 ? 10 : 8)) {
+        frame_converted->pict_type = AV_PICTURE_TYPE_I;
+        if (ts->stats)
+            ts->stats->scene_cuts++;
+        if (ts->scene_cuts && frame_converted->pts != AV_NOPTS_VALUE)
+            fprintf(ts->scene_cuts, "%.6f\n", frame_converted->pts * av_q2d(ts->enc_ctx->time_base));
+    }
+
+    // Brand the frame last, so the detectors above see only the picture
+    if (ts->logo)
+        logo_overlay_apply(ts->logo, frame_converted);
+
+    // Encode the frame
+    return encode_frame(ts, frame_converted);
+}
+
+// Encodes every frame the filter graph has ready
+static int drain_filter(TranscodeState* ts) {
+    for (;;) {
+        int ret = filter_stage_pull(ts->filter, ts->frame_filtered);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        else if (ret < 0) {
+            fprintf(stderr, "Error during filtering\n");
+            return ret;
+        }
+        ret = encode_picture(ts, ts->frame_filtered);
+        av_frame_unref(ts->frame_filtered);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+// Crops a decoded frame and passes it through the filter graph, if any, on
+// to be encoded
+static int process_decoded_frame(TranscodeState* ts, AVFrame* frame_decoded) {
+    // Frames outside the requested range were only decoded as references
+    if (frame_decoded->pts != AV_NOPTS_VALUE) {
+        if (ts->start_pts != AV_NOPTS_VALUE && frame_decoded->pts < ts->start_pts)
+            return 0;
+        if (ts->end_pts != AV_NOPTS_VALUE && frame_decoded->pts >= ts->end_pts) {
+            ts->reached_end = true;
+            return 0;
+        }
+    }
+
+    // Cut away the black bars by moving the frame's data pointers onto the
+    // picture; the scaler then reads only the picture area
+    const CropArea* crop = &ts->crop;
+    if (crop->width > 0 && frame_decoded->width == crop->source_width &&
+        frame_decoded->height == crop->source_height) {
+        frame_decoded->crop_left = crop->x;
+        frame_decoded->crop_top = crop->y;
+        frame_decoded->crop_right = crop->source_width - crop->x - crop->width;
+        frame_decoded->crop_bottom = crop->source_height - crop->y - crop->height;
+        int ret = av_frame_apply_cropping(frame_decoded, AV_FRAME_CROP_UNALIGNED);
+        if (ret < 0) {
+            fprintf(stderr, "Error cropping frame\n");
+            return ret;
+        }
+    }
+
+    if (!ts->filter)
+        return encode_picture(ts, frame_decoded);
+    int ret = filter_stage_push(ts->filter, frame_decoded);
+    if (ret < 0) {
+        fprintf(stderr, "Error feeding the filter graph\n");
+        return ret;
+    }
+    return drain_filter(ts);
+}
+
+// Processes every frame the decoder has ready
+static int receive_decoded_frames(TranscodeState* ts, AVFrame* frame_decoded) {
+    for (;;) {
+        int ret = avcodec_receive_frame(ts->dec_ctx, frame_decoded);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        else if (ret < 0) {
+            fprintf(stderr, "Error during decoding\n");
+            return ret;
+        }
+        ret = process_decoded_frame(ts, frame_decoded);
+        av_frame_unref(frame_decoded);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+void video_converter_default_options(VideoConverterOptions* options) {
+    options->thread_count = 0;
+    options->async_io = 0;
+    options->output_buffer_size = 0;
+    options->direct_io = 0;
+    options->stats = nullptr;
+    options->probe_size = 0;
+    options->analyze_duration = 0;
+    options->fragmented_output = 0;
+    options->fragment_duration = 0;
+    options->segment_format = VIDEO_CONVERTER_SEGMENTS_NONE;
+    options->segment_duration = 6.0;
+    options->faststart = 0;
+    options->start_time = 0;
+    options->end_time = 0;
+    options->smart_render = 0;
+    options->thumbnail_prefix = nullptr;
+    options->thumbnail_width = 160;
+    options->thumbnail_interval = 0;
+    options->preview_file = nullptr;
+    options->preview_width = 480;
+    options->preview_bit_rate = 500000;
+    options->proxy_mode = 0;
+    options->proxy_height = 540;
+    options->index_file = nullptr;
+    options->frame_stats_file = nullptr;
+    options->scene_detection = 0;
+    options->scene_threshold = 0.25;
+    options->scene_cuts_file = nullptr;
+    options->scale_threads = 1;
+    options->scale_quality = VIDEO_CONVERTER_SCALE_BALANCED;
+    options->max_width = 0;
+    options->max_height = 0;
+    options->max_fps = 0;
+    options->high_bit_depth = 1;
+    options->crop_detection = 0;
+    options->drop_duplicates = 0;
+    options->duplicate_threshold = 3;
+    options->filter_graph = nullptr;
+    options->logo_file = nullptr;
+    options->logo_x = -16;
+    options->logo_y = 16;
+}
+
+void convert_video_to_h265(const char* input_file, const char* output_file, int thread_count) {
+    VideoConverterOptions options;
+    video_converter_default_options(&options);
+    options.thread_count = thread_count;
+    convert_video_to_h265_with_options(input_file, output_file, &options);
+}
+
+void convert_video_to_h265_with_options(const char* input_file, const char* output_file,
+                                        const VideoConverterOptions* options) {
+    int ret = 0; // Declare at the top to avoid goto crossing initialization
+    AVRational frame_rate;
+    // What the scaler receives: decoded frames after cropping and filtering
+    int picture_width, picture_height, picture_format;
+    AVRational picture_sar, picture_frame_rate;
+    AVDictionary* mux_opts = nullptr;
+    bool moov_reserved = false, discard_output = false;
+    int64_t in_stream_start = 0;
+    TranscodeState ts = {};
+    SideOutputConfig side_config;
+    ts.start_pts = AV_NOPTS_VALUE;
+    ts.end_pts = AV_NOPTS_VALUE;
+    ts.last_pts = AV_NOPTS_VALUE;
+    ts.repeat_pts = AV_NOPTS_VALUE;
+    if (options->stats)
+        memset(options->stats, 0, sizeof(*options->stats));
+
+    // Open the input file. Pipes and FIFOs are read strictly front to back, so
+    // probing is bounded to let transcoding start while data is still arriving.
+    AVDictionary* in_opts = nullptr;
+    if (options->probe_size > 0)
+        av_dict_set_int(&in_opts, "probesize", options->probe_size, 0);
+    if (options->analyze_duration > 0)
+        av_dict_set_int(&in_opts, "analyzeduration", options->analyze_duration, 0);
+    AVFormatContext* in_fmt_ctx = nullptr;
+    AVIOContext* in_pb = nullptr;
+    ret = input_file_open(input_file, options->async_io, &in_opts, &in_fmt_ctx, &in_pb);
+    av_dict_free(&in_opts);
+    if (ret < 0)
+        return;
+    if (avformat_find_stream_info(in_fmt_ctx, nullptr) < 0) {
+        fprintf(stderr, "Failed to retrieve input stream information\n");
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Find the best video stream
+    int video_stream_index = av_find_best_stream(in_fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_stream_index < 0) {
+        fprintf(stderr, "Failed to find video stream in input file\n");
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+    AVStream* in_video_stream = in_fmt_ctx->streams[video_stream_index];
+    if (in_video_stream->start_time != AV_NOPTS_VALUE)
+        in_stream_start = in_video_stream->start_time;
+
+    // Trim HEVC input by copying whole GOPs and re-encoding only the cut points.
+    // It writes a plain seekable MP4; fragmented, segmented and piped output go
+    // through the regular transcode.
+    if (options->smart_render && (options->start_time > 0 || options->end_time > 0) &&
+        in_video_stream->codecpar->codec_id == AV_CODEC_ID_HEVC && !options->fragmented_output &&
+        options->segment_format == VIDEO_CONVERTER_SEGMENTS_NONE &&
+        !is_streamed_output(output_url(output_file))) {
+        ret = smart_render_hevc(in_fmt_ctx, video_stream_index, output_url(output_file),
+                                options->start_time, options->end_time, options->thread_count,
+                                options->faststart != 0);
+        if (ret != AVERROR(ENOSYS)) {
+            if (ret < 0)
+                fprintf(stderr, "Smart render failed\n");
+            input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+            return;
+        }
+    }
+
+    // Open the decoder for the video stream
+    const AVCodec* decoder = avcodec_find_decoder(in_video_stream->codecpar->codec_id);
+    if (!decoder) {
+        fprintf(stderr, "Decoder not found\n");
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+    AVCodecContext* dec_ctx = avcodec_alloc_context3(decoder);
+    if (!dec_ctx) {
+        fprintf(stderr, "Could not allocate decoder context\n");
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+    if (avcodec_parameters_to_context(dec_ctx, in_video_stream->codecpar) < 0) {
+        fprintf(stderr, "Failed to copy decoder parameters to input decoder context\n");
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+    if (options->proxy_mode)
+        set_proxy_decoder_options(dec_ctx, decoder, in_video_stream->codecpar->height,
+                                  options->proxy_height);
+    if (avcodec_open2(dec_ctx, decoder, nullptr) < 0) {
+        fprintf(stderr, "Failed to open decoder for stream\n");
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Letterboxed or pillarboxed input is encoded without its bars
+    if (options->crop_detection &&
+        detect_crop(in_fmt_ctx, video_stream_index, dec_ctx, &ts.crop) < 0) {
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Frames reach the scaler cropped, then filtered
+    picture_width = ts.crop.width > 0 ? ts.crop.width : dec_ctx->width;
+    picture_height = ts.crop.width > 0 ? ts.crop.height : dec_ctx->height;
+    picture_format = dec_ctx->pix_fmt;
+    picture_sar = dec_ctx->sample_aspect_ratio;
+    picture_frame_rate = dec_ctx->framerate.num ? dec_ctx->framerate : in_video_stream->r_frame_rate;
+    ts.frame_time_base = in_video_stream->time_base;
+    if (options->filter_graph) {
+        ts.filter = filter_stage_open(options->filter_graph, options->thread_count, picture_width,
+                                      picture_height, picture_format, picture_sar,
+                                      in_video_stream->time_base, picture_frame_rate);
+        if (!ts.filter) {
+            avcodec_free_context(&dec_ctx);
+            input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+            return;
+        }
+        filter_stage_output(ts.filter, &picture_width, &picture_height, &picture_format, &picture_sar,
+                            &ts.frame_time_base, &picture_frame_rate);
+    }
+
+    // Allocate the output format context (using MP4 container, or HLS/DASH
+    // muxers writing fMP4 segments)
+    AVFormatContext* out_fmt_ctx = nullptr;
+    const char* out_url = output_url(output_file);
+    bool segmented = options->segment_format != VIDEO_CONVERTER_SEGMENTS_NONE;
+    // A regular MP4 seeks back to write moov, which a pipe cannot do
+    bool fragmented = !segmented && (options->fragmented_output || is_streamed_output(out_url));
+    if (avformat_alloc_output_context2(&out_fmt_ctx, nullptr, output_muxer_name(options), out_url) < 0) {
+        fprintf(stderr, "Could not create output context\n");
+        filter_stage_close(&ts.filter);
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Find the H.265 encoder (HEVC)
+    const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_HEVC);
+    if (!encoder) {
+        fprintf(stderr, "Necessary encoder not found\n");
+        avformat_free_context(out_fmt_ctx);
+        filter_stage_close(&ts.filter);
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Create a new video stream in the output file
+    AVStream* out_stream = avformat_new_stream(out_fmt_ctx, nullptr);
+    if (!out_stream) {
+        fprintf(stderr, "Failed allocating output stream\n");
+        avformat_free_context(out_fmt_ctx);
+        filter_stage_close(&ts.filter);
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Allocate and configure the encoder context
+    AVCodecContext* enc_ctx = avcodec_alloc_context3(encoder);
+    if (!enc_ctx) {
+        fprintf(stderr, "Failed to allocate the encoder context\n");
+        avformat_free_context(out_fmt_ctx);
+        filter_stage_close(&ts.filter);
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Set encoder parameters. You can tweak these values.
+    enc_ctx->height = picture_height;
+    enc_ctx->width = picture_width;
+    // Encode no more pixels than the delivery target needs
+    if (options->proxy_mode)
+        cap_output_size(0, options->proxy_height, &enc_ctx->width, &enc_ctx->height);
+    if (options->max_width > 0 || options->max_height > 0)
+        cap_output_size(options->max_width, options->max_height, &enc_ctx->width, &enc_ctx->height);
+    enc_ctx->sample_aspect_ratio = picture_sar;
+    // YUV420P (main), or YUV420P10 (main10) for high-bit-depth sources
+    enc_ctx->pix_fmt = select_output_format(encoder, (enum AVPixelFormat)picture_format, options);
+    copy_color_properties(enc_ctx, dec_ctx, (enum AVPixelFormat)picture_format);
+    frame_rate = picture_frame_rate;
+    // A tightly bounded probe of piped input may not have settled on a frame rate
+    if (!frame_rate.num || !frame_rate.den)
+        frame_rate = av_guess_frame_rate(in_fmt_ctx, in_video_stream, nullptr);
+    if (!frame_rate.num || !frame_rate.den)
+        frame_rate = av_make_q(25, 1);
+    // Above the cap the encoder ticks at the capped rate; encode_picture drops
+    // the frames that land on an occupied tick
+    if (options->max_fps > 0 && av_q2d(frame_rate) > options->max_fps)
+        frame_rate = av_d2q(options->max_fps, 100000);
+    enc_ctx->time_base = av_inv_q(frame_rate);
+    enc_ctx->framerate = frame_rate;
+    // MP4 keeps parameter sets in the sample description; an empty moov is
+    // written before the first packet, so they have to come from extradata
+    if (out_fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    // Set preset options if supported
+    av_opt_set(enc_ctx->priv_data, "preset", options->proxy_mode ? "ultrafast" : "medium", 0);
+    if (enc_ctx->pix_fmt == AV_PIX_FMT_YUV420P10)
+        av_opt_set(enc_ctx->priv_data, "profile", "main10", 0);
+    // Set the number of threads via AVOptions
+    av_opt_set_int(enc_ctx->priv_data, "threads", options->thread_count, 0);
+    // Segment boundaries and scene cuts are placed by forcing keyframes; make
+    // them IDRs so every segment or chunk decodes on its own
+    if (segmented || options->scene_detection)
+        av_opt_set_int(enc_ctx->priv_data, "forced-idr", 1, 0);
+    if (segmented) {
+        ts.segment_pts = av_rescale_q((int64_t)(options->segment_duration * AV_TIME_BASE),
+                                   AV_TIME_BASE_Q, enc_ctx->time_base);
+    }
+
+    // Open the encoder
+    if (avcodec_open2(enc_ctx, encoder, nullptr) < 0) {
+        fprintf(stderr, "Cannot open video encoder for stream\n");
+        avcodec_free_context(&enc_ctx);
+        avformat_free_context(out_fmt_ctx);
+        filter_stage_close(&ts.filter);
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Copy encoder parameters to the output stream
+    if (avcodec_parameters_from_context(out_stream->codecpar, enc_ctx) < 0) {
+        fprintf(stderr, "Failed to copy encoder parameters to output stream\n");
+        avcodec_free_context(&enc_ctx);
+        avformat_free_context(out_fmt_ctx);
+        filter_stage_close(&ts.filter);
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+    out_stream->time_base = enc_ctx->time_base;
+
+    // Load the logo before anything is written, so a bad logo file leaves no
+    // partial output behind
+    if (options->logo_file) {
+        ts.logo = logo_overlay_open(options->logo_file, options->logo_x, options->logo_y, enc_ctx->width,
+                                    enc_ctx->height, enc_ctx->pix_fmt, enc_ctx->colorspace,
+                                    enc_ctx->color_range);
+        if (!ts.logo) {
+            avcodec_free_context(&enc_ctx);
+            avformat_free_context(out_fmt_ctx);
+            filter_stage_close(&ts.filter);
+            avcodec_free_context(&dec_ctx);
+            input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+            return;
+        }
+    }
+
+    // Open the output file if needed
+    if (!(out_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        if (open_output_io(out_fmt_ctx, out_url, options) < 0) {
+            fprintf(stderr, "Could not open output file '%s'\n", output_file);
+            avcodec_free_context(&enc_ctx);
+            avformat_free_context(out_fmt_ctx);
+            filter_stage_close(&ts.filter);
+            logo_overlay_free(&ts.logo);
+            avcodec_free_context(&dec_ctx);
+            input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+            return;
+        }
+    }
+
+    // Fragmented output starts with an empty moov and then appends a
+    // self-contained moof/mdat pair per keyframe interval, so readers can
+    // consume it while it is still being written
+    if (fragmented) {
+        av_dict_set(&mux_opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        if (options->fragment_duration > 0)
+            av_dict_set_int(&mux_opts, "frag_duration", options->fragment_duration, 0);
+    }
+    if (segmented)
+        set_segment_muxer_options(&mux_opts, options);
+    // Faststart without the muxer's post-trailer rewrite: reserve room for moov
+    // right after ftyp and fill it in at the end. Fragmented output already
+    // leads with its (empty) moov.
+    if (options->faststart && !segmented && !fragmented) {
+        int64_t moov_size = estimate_moov_size(in_fmt_ctx, in_video_stream, frame_rate, options);
+        moov_reserved = moov_size > 0;
+        if (moov_reserved)
+            av_dict_set_int(&mux_opts, "moov_size", moov_size, 0);
+        else
+            fprintf(stderr, "Input duration unknown, writing moov at the end of the file\n");
+    }
+
+    // Write the stream header to the output file
+    ret = avformat_write_header(out_fmt_ctx, &mux_opts);
+    av_dict_free(&mux_opts);
+    if (ret < 0) {
+        fprintf(stderr, "Error occurred when opening output file\n");
+        if (!(out_fmt_ctx->oformat->flags & AVFMT_NOFILE))
+            close_output_io(out_fmt_ctx, options);
+        avcodec_free_context(&enc_ctx);
+        avformat_free_context(out_fmt_ctx);
+        filter_stage_close(&ts.filter);
+        logo_overlay_free(&ts.logo);
+        avcodec_free_context(&dec_ctx);
+        input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+        return;
+    }
+
+    // Allocate frames and packets for conversion
+    AVFrame* frame_decoded = av_frame_alloc();
+    AVFrame* frame_converted = av_frame_alloc();
+    ts.frame_filtered = av_frame_alloc();
+    AVPacket* packet_in = av_packet_alloc();
+    AVPacket* packet_out = av_packet_alloc();
+
+    // Prepare a scaler from the decoder's pixel format to the encoder's. A
+    // 10-bit source going to main10 keeps its precision, with no dithering.
+    // Large frames are converted in bands on several threads. Should the input
+    // change resolution or format mid-stream, scalers for the new geometry
+    // join the cache, and a new aspect ratio is padded to the output's.
+    ScalerCache* scaler = scaler_cache_create(
+        kScalerCacheSize, options->scale_threads, enc_ctx->width, enc_ctx->height, enc_ctx->sample_aspect_ratio,
+        enc_ctx->pix_fmt, options->proxy_mode ? VIDEO_CONVERTER_SCALE_FAST : options->scale_quality);
+    if (!scaler ||
+        scaler_cache_prepare(scaler, picture_width, picture_height, picture_format, picture_sar) < 0) {
+        fprintf(stderr, "Could not initialize the conversion context\n");
+        goto cleanup;
+    }
+
+    // Allocate buffer for the converted frame. It is reference counted so the
+    // scaler threads and the encoder can share it without copies.
+    frame_converted->width  = enc_ctx->width;
+    frame_converted->height = enc_ctx->height;
+    frame_converted->format = enc_ctx->pix_fmt;
+    frame_converted->color_range = enc_ctx->color_range;
+    frame_converted->pts = 0;
+    ret = av_frame_get_buffer(frame_converted, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Could not allocate raw picture buffer\n");
+        goto cleanup;
+    }
+
+    // Jump to the keyframe at or before the requested start rather than
+    // decoding everything in front of it. Non-seekable input is decoded from
+    // the beginning and the frames before the start are dropped.
+    if (options->start_time > 0) {
+        ts.start_pts = in_stream_start + av_rescale_q(options->start_time, AV_TIME_BASE_Q,
+                                                      in_video_stream->time_base);
+        ts.pts_offset = ts.start_pts;
+        if (!in_fmt_ctx->pb || in_fmt_ctx->pb->seekable) {
+            if (avformat_seek_file(in_fmt_ctx, video_stream_index, INT64_MIN, ts.start_pts,
+                                   ts.start_pts, 0) < 0)
+                fprintf(stderr, "Seek to start time failed, decoding from the beginning\n");
+        }
+    }
+    ts.frame_pts_offset = av_rescale_q(ts.pts_offset, in_video_stream->time_base, ts.frame_time_base);
+    if (options->end_time > 0)
+        ts.end_pts = in_stream_start + av_rescale_q(options->end_time, AV_TIME_BASE_Q,
+                                                    in_video_stream->time_base);
+
+    ts.in_stream = in_video_stream;
+    ts.dec_ctx = dec_ctx;
+    ts.enc_ctx = enc_ctx;
+    ts.out_fmt_ctx = out_fmt_ctx;
+    ts.out_stream = out_stream;
+    ts.scaler = scaler;
+    ts.frame_converted = frame_converted;
+    ts.packet_out = packet_out;
+    side_config.thumbnail_prefix = options->thumbnail_prefix;
+    side_config.thumbnail_width = options->thumbnail_width;
+    side_config.thumbnail_interval = options->thumbnail_interval;
+    side_config.preview_file = options->preview_file;
+    side_config.preview_width = options->preview_width;
+    side_config.preview_bit_rate = options->preview_bit_rate;
+    side_config.thread_count = options->thread_count;
+    ts.side_outputs = side_outputs_open(&side_config, ts.frame_time_base, frame_rate);
+    ts.stats = options->stats;
+    if (options->scene_detection) {
+        // At least half a second between cuts, so flashes do not each get an IDR
+        ts.scene_detector = scene_detector_create(options->scene_threshold,
+                                                  (int)(av_q2d(frame_rate) / 2) + 1);
+        if (options->scene_cuts_file) {
+            ts.scene_cuts = fopen(options->scene_cuts_file, "w");
+            if (!ts.scene_cuts)
+                fprintf(stderr, "Could not open scene cuts file '%s'\n", options->scene_cuts_file);
+        }
+    }
+    // Never more than a second between frames kept, so GOPs and seeking do
+    // not stretch out over long static stretches
+    if (options->drop_duplicates)
+        ts.duplicate_detector = duplicate_detector_create(options->duplicate_threshold,
+                                                          (int)(av_q2d(frame_rate) + 0.5));
+    if (options->frame_stats_file)
+        ts.frame_stats = frame_stats_open(options->frame_stats_file, enc_ctx->time_base.num,
+                                          enc_ctx->time_base.den);
+    // Opened after the header, which fixes the output stream's time base
+    if (options->index_file) {
+        ts.packet_index = packet_index_open(options->index_file, out_stream->time_base.num,
+                                            out_stream->time_base.den);
+        ts.index_offsets = segmented ? INDEX_OFFSETS_NONE :
+            fragmented ? INDEX_OFFSETS_FRAGMENT : INDEX_OFFSETS_EXACT;
+        if (fragmented)
+            ts.fragment_offset = avio_tell(out_fmt_ctx->pb);
+    }
+
+    // Main conversion loop: read, decode, convert, encode, and write
+    while (!ts.reached_end && av_read_frame(in_fmt_ctx, packet_in) >= 0) {
+        if (packet_in->stream_index == video_stream_index) {
+            ret = avcodec_send_packet(dec_ctx, packet_in);
+            if (ret < 0) {
+                fprintf(stderr, "Error sending packet for decoding\n");
+                break;
+            }
+            if (receive_decoded_frames(&ts, frame_decoded) < 0)
+                goto cleanup;
+        }
+        av_packet_unref(packet_in);
+    }
+    av_packet_unref(packet_in);
+
+    // Drain the decoder, then the encoder's lookahead, so the last frames are kept
+    avcodec_send_packet(dec_ctx, nullptr);
+    if (receive_decoded_frames(&ts, frame_decoded) < 0)
+        goto cleanup;
+    if (ts.filter && (filter_stage_push(ts.filter, nullptr) < 0 || drain_filter(&ts) < 0))
+        goto cleanup;
+    // Duplicates dropped at the very end still count towards the duration:
+    // show the last frame kept once more at the last of them
+    if (ts.repeat_pts != AV_NOPTS_VALUE) {
+        if (av_frame_make_writable(frame_converted) < 0)
+            goto cleanup;
+        frame_converted->pts = ts.repeat_pts;
+        frame_converted->pict_type = AV_PICTURE_TYPE_NONE;
+        if (encode_frame(&ts, frame_converted) < 0)
+            goto cleanup;
+    }
+    if (encode_frame(&ts, nullptr) < 0)
+        goto cleanup;
+
+    // Write trailer to output file
+    ret = av_write_trailer(out_fmt_ctx);
+    if (ret < 0) {
+        fprintf(stderr, "Error writing output trailer\n");
+        // The muxer only checks the reserved moov space after filling it, so
+        // an overflow has already overwritten the start of mdat
+        if (moov_reserved) {
+            fprintf(stderr, "The moov box did not fit in the space reserved for faststart\n");
+            discard_output = true;
+        }
+    }
+
+cleanup:
+    if (side_outputs_close(&ts.side_outputs) < 0)
+        fprintf(stderr, "Some side outputs were not written\n");
+    if (packet_index_close(&ts.packet_index) < 0)
+        fprintf(stderr, "Error writing packet index\n");
+    if (frame_stats_close(&ts.frame_stats) < 0)
+        fprintf(stderr, "Error writing frame stats\n");
+    scene_detector_free(&ts.scene_detector);
+    duplicate_detector_free(&ts.duplicate_detector);
+    filter_stage_close(&ts.filter);
+    av_frame_free(&ts.frame_filtered);
+    logo_overlay_free(&ts.logo);
+    if (ts.scene_cuts && fclose(ts.scene_cuts) != 0)
+        fprintf(stderr, "Error writing scene cuts file\n");
+    scaler_cache_free(&scaler);
+    av_frame_free(&frame_converted);
+    av_frame_free(&frame_decoded);
+    av_packet_free(&packet_in);
+    av_packet_free(&packet_out);
+    if (out_fmt_ctx && !(out_fmt_ctx->oformat->flags & AVFMT_NOFILE))
+        close_output_io(out_fmt_ctx, options);
+    if (discard_output && remove(output_file) == 0)
+        fprintf(stderr, "Removed corrupt output file '%s'\n", output_file);
+    avcodec_free_context(&enc_ctx);
+    avcodec_free_context(&dec_ctx);
+    input_file_close(&in_fmt_ctx, &in_pb, options->async_io);
+    avformat_free_context(out_fmt_ctx);
+}
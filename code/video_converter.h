@@ -1,17 +1,220 @@
-#ifndef IMAGE_CONVERTER_H
-#define IMAGE_CONVERTER_H
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-// Converts an image (in any supported format) to a JPEG image.
-// input_file  - path to the source image file (e.g., PNG, BMP, TIFF, etc.)
-// output_file - path to the JPEG output file.
-void convert_video_to_h265(const char* input_file, const char* output_file, int thread_count);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif // IMAGE_CONVERTER_H
+#ifndef IMAGE_CONVERTER_H
+#define IMAGE_CONVERTER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counters describing a finished conversion.
+typedef struct VideoConverterStats {
+    // Bytes handed to storage by the write-behind writer (async_io only).
+    int64_t output_bytes_written;
+    // Time the encode loop spent blocked waiting for output storage, in
+    // microseconds, and how many times it had to wait (async_io only).
+    int64_t output_blocked_us;
+    int64_t output_blocked_waits;
+    // Scene cuts found by scene_detection.
+    int64_t scene_cuts;
+    // Decoded frames not encoded because they fell on an output frame slot
+    // that was already filled (max_fps, or bunched variable-rate input).
+    int64_t frames_dropped;
+    // Frames left out as repeats of the previous one (drop_duplicates)
+    int64_t duplicates_dropped;
+} VideoConverterStats;
+
+// Segmented output layouts for VideoConverterOptions.segment_format. Segments
+// are fMP4 (CMAF) files written next to output_file.
+typedef enum VideoConverterSegmentFormat {
+    VIDEO_CONVERTER_SEGMENTS_NONE = 0, // Single MP4 file
+    VIDEO_CONVERTER_SEGMENTS_HLS,      // output_file is the .m3u8 playlist
+    VIDEO_CONVERTER_SEGMENTS_DASH,     // output_file is the .mpd manifest
+    VIDEO_CONVERTER_SEGMENTS_HLS_DASH  // .mpd manifest plus HLS playlists over the same segments
+} VideoConverterSegmentFormat;
+
+// Speed/quality preference for resizing, VideoConverterOptions.scale_quality.
+// Conversions that only change the pixel format never resample.
+typedef enum VideoConverterScaleQuality {
+    VIDEO_CONVERTER_SCALE_BALANCED = 0, // Bilinear for 2x+ downscales, bicubic otherwise
+    VIDEO_CONVERTER_SCALE_FAST,         // Fast bilinear
+    VIDEO_CONVERTER_SCALE_BEST          // Lanczos
+} VideoConverterScaleQuality;
+
+// Optional behaviour for convert_video_to_h265_with_options. Always start from
+// video_converter_default_options() so fields added later keep their defaults.
+typedef struct VideoConverterOptions {
+    // Number of encoder threads.
+    int thread_count;
+    // Non-zero to keep several large reads in flight ahead of the demuxer and
+    // write muxed output behind the encode loop (io_uring where available,
+    // worker threads otherwise). Intended for high-latency storage.
+    int async_io;
+    // Total size in bytes of the page-aligned write-behind buffer ring used
+    // with async_io. 0 picks the default (64 MiB).
+    int64_t output_buffer_size;
+    // Non-zero to write output with O_DIRECT, bypassing the page cache, where
+    // the platform and filesystem support it (async_io only).
+    int direct_io;
+    // When non-null, filled in once the conversion finishes.
+    VideoConverterStats* stats;
+    // Upper bounds for stream probing: bytes read and media duration in
+    // microseconds. 0 keeps FFmpeg's defaults. Small values let piped input
+    // start transcoding sooner at the risk of missing late-starting streams.
+    int64_t probe_size;
+    int64_t analyze_duration;
+    // Non-zero to write fragmented MP4: an empty moov followed by a moof/mdat
+    // pair per keyframe interval, so the file can be uploaded or played while
+    // it is still being written. Always on when output_file is a pipe.
+    int fragmented_output;
+    // Longest fragment in microseconds for fragmented output. 0 starts a new
+    // fragment at every keyframe only.
+    int64_t fragment_duration;
+    // Writes HLS and/or DASH segments and manifests straight from the encode
+    // loop instead of a single MP4 (one of VideoConverterSegmentFormat).
+    int segment_format;
+    // Target segment length in seconds. Keyframes are forced at these
+    // boundaries so segments always start with an IDR.
+    double segment_duration;
+    // Non-zero to put moov at the front of a regular MP4 for progressive
+    // playback. Space for it is reserved up front from the input's length, so
+    // no second pass rewrites the file. Ignored when the length is unknown.
+    int faststart;
+    // Range of the input to transcode, in microseconds from the start of the
+    // video stream. 0 means from the beginning / to the end. Seekable inputs
+    // jump to the keyframe before start_time, so the cost of a clip scales
+    // with its length rather than its position. The output starts at zero.
+    int64_t start_time;
+    int64_t end_time;
+    // Non-zero to trim HEVC input without a full re-encode: GOPs inside the
+    // range are copied and only the partial GOPs at the cut points are
+    // re-encoded. Writes a plain MP4 (the output layout options do not apply)
+    // and falls back to a full transcode when the input cannot be spliced.
+    int smart_render;
+    // Side outputs cut from the same decoded frames as the main encode, on a
+    // separate thread. When thumbnail_prefix is set, scrubbing thumbnails
+    // thumbnail_width pixels wide are written as JPEG sprite sheets plus a
+    // WebVTT index (see extract_video_thumbnails), one every
+    // thumbnail_interval microseconds or, when 0, one per keyframe.
+    const char* thumbnail_prefix;
+    int thumbnail_width;
+    int64_t thumbnail_interval;
+    // When set, a small low-bitrate preview MP4 (H.264 where available) of at
+    // most preview_width pixels wide is written to preview_file.
+    const char* preview_file;
+    int preview_width;
+    int64_t preview_bit_rate;
+    // Non-zero for fast low-resolution editing proxies: output is scaled down
+    // to at most proxy_height lines, the decoder takes every shortcut that
+    // stays visually acceptable (reduced-resolution decoding where the codec
+    // supports it, no loop filter, no IDCT on non-reference frames) and
+    // x265 runs its fastest preset.
+    int proxy_mode;
+    int proxy_height;
+    // When set, a compact binary seek index (pts, dts, byte offset, size and
+    // picture type of every output packet; format in packet_index.h) is
+    // written to index_file while the output is muxed.
+    const char* index_file;
+    // When set, per-frame encoder statistics (picture type, packet size,
+    // average QP and encode latency; format in frame_stats.h) are streamed to
+    // frame_stats_file as CSV for preset tuning.
+    const char* frame_stats_file;
+    // Non-zero to detect shot changes on the frames about to be encoded and
+    // start each new scene with an IDR. scene_threshold is the change score
+    // (0-1) that counts as a cut; lower finds more cuts. When
+    // scene_cuts_file is set, the cut times (seconds, one per line) are
+    // written there as split points for parallel chunked encoding.
+    int scene_detection;
+    double scene_threshold;
+    const char* scene_cuts_file;
+    // Threads converting each frame to the encoder's format, in horizontal
+    // bands. The default of 1 converts on the calling thread, leaving the
+    // cores to the encoder; 0 picks one per core. Small frames use fewer.
+    int scale_threads;
+    // Resampling filter preference when the output size differs from the
+    // input (one of VideoConverterScaleQuality). proxy_mode implies fast.
+    int scale_quality;
+    // Delivery caps bounding the encode cost. Larger input is scaled down to
+    // fit within max_width x max_height keeping its aspect ratio, and
+    // frames above max_fps are dropped before they are converted or encoded.
+    // 0 means no limit.
+    int max_width;
+    int max_height;
+    double max_fps;
+    // Encode sources with more than 8 bits per sample as HEVC main10
+    // (yuv420p10) instead of converting them down to 8 bits. On by default;
+    // proxy output is always 8-bit.
+    int high_bit_depth;
+    // Detect black bars (letterbox, pillarbox) on frames sampled across the
+    // input before encoding starts, and encode only the picture inside them.
+    // Needs seekable input with a known duration; otherwise nothing is cropped.
+    int crop_detection;
+    // Leave out frames that repeat the previous one (slideshows, lectures,
+    // static screen recordings) so the output becomes variable frame rate.
+    // A frame is a repeat while no 8x8 block's mean luma has changed by more
+    // than duplicate_threshold 8-bit levels; at least one frame per second
+    // is kept.
+    int drop_duplicates;
+    int duplicate_threshold;
+    // libavfilter graph run between decoding and encoding, in ffmpeg's -vf
+    // syntax (e.g. "bwdif,hqdn3d" or "movie=logo.png[l];[in][l]overlay=10:10"),
+    // or nullptr for none. Uses up to thread_count threads.
+    const char* filter_graph;
+    // Static logo (e.g. a PNG with alpha) blended onto every output frame, or
+    // nullptr for none. logo_x and logo_y place its top-left corner on the
+    // output picture; negative values count from the right and bottom edges.
+    // Cheaper than an overlay in filter_graph.
+    const char* logo_file;
+    int logo_x;
+    int logo_y;
+} VideoConverterOptions;
+
+// Fills `options` with the defaults used by convert_video_to_h265.
+void video_converter_default_options(VideoConverterOptions* options);
+
+// Converts a video (in any supported format) to an MP4 with H.265 video.
+// input_file  - path to the source video file (e.g., MP4, MKV, AVI, etc.),
+//               a FIFO, "pipe:N" or "-" for standard input. Non-seekable inputs
+//               are read strictly front to back.
+// output_file - path to the MP4 output file, a FIFO, "pipe:N" or "-" for
+//               standard output (pipes get fragmented MP4).
+void convert_video_to_h265(const char* input_file, const char* output_file, int thread_count);
+
+// Same as convert_video_to_h265, with the behaviour controlled by `options`.
+void convert_video_to_h265_with_options(const char* input_file, const char* output_file,
+                                        const VideoConverterOptions* options);
+
+// Options for extract_video_thumbnails. Start from
+// video_thumbnail_default_options().
+typedef struct VideoThumbnailOptions {
+    // Width of each thumbnail in pixels; the height keeps the display aspect
+    // ratio.
+    int thumb_width;
+    // Thumbnails per sprite sheet row and rows per sheet.
+    int columns;
+    int rows;
+    // Minimum time between thumbnails in microseconds. The first keyframe at
+    // or after each step is used. 0 takes every keyframe.
+    int64_t interval;
+    // JPEG quality scale, 2 (best) to 31 (smallest).
+    int quality;
+    // Number of decoder threads.
+    int thread_count;
+} VideoThumbnailOptions;
+
+// Fills `options` with the defaults: 160 pixel wide thumbnails, 10x10 sheets,
+// every keyframe.
+void video_thumbnail_default_options(VideoThumbnailOptions* options);
+
+// Writes scrubbing thumbnails for input_file as JPEG sprite sheets
+// ("<output_prefix>_001.jpg", ...) plus a WebVTT index ("<output_prefix>.vtt")
+// mapping time ranges to tiles. Only keyframes are decoded, so this is far
+// cheaper than a full decode of the input.
+void extract_video_thumbnails(const char* input_file, const char* output_prefix,
+                              const VideoThumbnailOptions* options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMAGE_CONVERTER_H
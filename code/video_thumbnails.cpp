@@ -0,0 +1,153 @@
+#include "video_converter.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "input_file.h"
+#include "sprite_sheet.h"
+
+#include <cstdio>
+
+void video_thumbnail_default_options(VideoThumbnailOptions* options) {
+    options->thumb_width = 160;
+    options->columns = 10;
+    options->rows = 10;
+    options->interval = 0;
+    options->quality = 5;
+    options->thread_count = 0;
+}
+
+// Decodes whatever `pkt` (nullptr flushes) produces and adds the frames that
+// are due to the sprite sheet
+static int add_decoded_frames(AVCodecContext* dec_ctx, AVStream* stream, int64_t stream_start,
+                              const VideoThumbnailOptions* options, SpriteSheetWriter* sprites,
+                              int64_t* next_time_us, AVFrame* frame) {
+    int ret;
+    while ((ret = avcodec_receive_frame(dec_ctx, frame)) >= 0) {
+        int64_t pts = frame->best_effort_timestamp;
+        int64_t time_us = pts == AV_NOPTS_VALUE ? *next_time_us :
+            av_rescale_q(pts - stream_start, stream->time_base, AV_TIME_BASE_Q);
+        if (time_us >= *next_time_us) {
+            ret = sprite_sheet_add(sprites, frame, time_us);
+            if (ret < 0) {
+                av_frame_unref(frame);
+                return ret;
+            }
+            *next_time_us = options->interval > 0 ? time_us + options->interval : time_us;
+        }
+        av_frame_unref(frame);
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+void extract_video_thumbnails(const char* input_file, const char* output_prefix,
+                              const VideoThumbnailOptions* options) {
+    int ret = 0; // Declare at the top to avoid goto crossing initialization
+    AVFormatContext* in_fmt_ctx = nullptr;
+    AVCodecContext* dec_ctx = nullptr;
+    SpriteSheetWriter* sprites = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* frame = nullptr;
+    AVStream* stream = nullptr;
+    int64_t stream_start = 0;
+    int64_t next_time_us = INT64_MIN;
+    int64_t end_us = 0;
+    const AVCodec* decoder = nullptr;
+    int video_stream_index;
+
+    AVIOContext* in_pb = nullptr;
+    if (input_file_open(input_file, 0, nullptr, &in_fmt_ctx, &in_pb) < 0)
+        return;
+    if (avformat_find_stream_info(in_fmt_ctx, nullptr) < 0) {
+        fprintf(stderr, "Failed to retrieve input stream information\n");
+        goto cleanup;
+    }
+    video_stream_index = av_find_best_stream(in_fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_stream_index < 0) {
+        fprintf(stderr, "Failed to find video stream in input file\n");
+        goto cleanup;
+    }
+    stream = in_fmt_ctx->streams[video_stream_index];
+    if (stream->start_time != AV_NOPTS_VALUE)
+        stream_start = stream->start_time;
+    if (stream->duration != AV_NOPTS_VALUE)
+        end_us = av_rescale_q(stream->duration, stream->time_base, AV_TIME_BASE_Q);
+    else if (in_fmt_ctx->duration != AV_NOPTS_VALUE)
+        end_us = in_fmt_ctx->duration;
+
+    // Only keyframes are wanted: demuxers that index their samples (MP4, MKV)
+    // skip the others without reading them, and the decoder drops any that
+    // still arrive, so the cost scales with the number of keyframes
+    for (unsigned i = 0; i < in_fmt_ctx->nb_streams; i++)
+        in_fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+    stream->discard = AVDISCARD_NONKEY;
+
+    decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!decoder) {
+        fprintf(stderr, "Decoder not found\n");
+        goto cleanup;
+    }
+    dec_ctx = avcodec_alloc_context3(decoder);
+    if (!dec_ctx) {
+        fprintf(stderr, "Could not allocate decoder context\n");
+        goto cleanup;
+    }
+    if (avcodec_parameters_to_context(dec_ctx, stream->codecpar) < 0) {
+        fprintf(stderr, "Failed to copy decoder parameters to input decoder context\n");
+        goto cleanup;
+    }
+    dec_ctx->pkt_timebase = stream->time_base;
+    dec_ctx->skip_frame = AVDISCARD_NONKEY;
+    dec_ctx->thread_count = options->thread_count;
+    if (avcodec_open2(dec_ctx, decoder, nullptr) < 0) {
+        fprintf(stderr, "Failed to open decoder for stream\n");
+        goto cleanup;
+    }
+
+    sprites = sprite_sheet_open(output_prefix, options->thumb_width, options->columns,
+                                options->rows, options->quality);
+    packet = av_packet_alloc();
+    frame = av_frame_alloc();
+    if (!sprites || !packet || !frame) {
+        fprintf(stderr, "Could not set up thumbnail output\n");
+        goto cleanup;
+    }
+
+    while (av_read_frame(in_fmt_ctx, packet) >= 0) {
+        // Keyframes that fall inside the current interval are not worth decoding
+        bool wanted = packet->stream_index == video_stream_index &&
+            (packet->flags & AV_PKT_FLAG_KEY);
+        if (wanted && options->interval > 0 && packet->pts != AV_NOPTS_VALUE)
+            wanted = av_rescale_q(packet->pts - stream_start, stream->time_base, AV_TIME_BASE_Q) >=
+                next_time_us;
+        if (wanted) {
+            ret = avcodec_send_packet(dec_ctx, packet);
+            if (ret < 0 && ret != AVERROR_INVALIDDATA) {
+                fprintf(stderr, "Error sending packet for decoding\n");
+                goto cleanup;
+            }
+            ret = add_decoded_frames(dec_ctx, stream, stream_start, options, sprites,
+                                     &next_time_us, frame);
+            if (ret < 0) {
+                fprintf(stderr, "Error while generating thumbnails\n");
+                goto cleanup;
+            }
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_unref(packet);
+
+    avcodec_send_packet(dec_ctx, nullptr);
+    if (add_decoded_frames(dec_ctx, stream, stream_start, options, sprites, &next_time_us, frame) < 0)
+        fprintf(stderr, "Error while generating thumbnails\n");
+
+cleanup:
+    if (sprites && sprite_sheet_close(&sprites, end_us) < 0)
+        fprintf(stderr, "Error while writing sprite sheets\n");
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&dec_ctx);
+    input_file_close(&in_fmt_ctx, &in_pb, 0);
+}